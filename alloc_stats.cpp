@@ -0,0 +1,292 @@
+/*
+    alloc_stats.cpp -- allocation accounting.  Replaces malloc(), calloc(), realloc(),
+    free(), the aligned allocators (memalign(), posix_memalign(), aligned_alloc(),
+    valloc() and pvalloc()), and the global operator new and delete, with versions
+    that count calls and bytes for each stage of the program before handing off to
+    the C library.
+
+    Linked only into the instrumented build (see the Makefile); the regular
+    build uses the ordinary allocator.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#include <cerrno>
+#include <stddef.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <new>
+#include "alloc_stats.h"
+
+// The C library's own entry points, which our replacements call:
+
+extern "C"
+{
+	void * __libc_malloc( size_t size );
+	void * __libc_calloc( size_t count, size_t size );
+	void * __libc_realloc( void * p, size_t size );
+	void * __libc_memalign( size_t alignment, size_t size );
+	void * __libc_valloc( size_t size );
+	void * __libc_pvalloc( size_t size );
+	void __libc_free( void * p );
+}
+
+namespace
+{
+
+struct StageStats
+{
+	unsigned long allocs;          // Calls that allocated (including realloc)
+	unsigned long frees;           // Calls that freed (including realloc)
+	unsigned long bytes;           // Total bytes requested
+	unsigned long peak;            // Most bytes in use at any time during the stage
+};
+
+const char * const stage_names[ STAGE_COUNT ] =
+{
+	"startup",
+	"get_opts",
+	"parse_path",
+	"build_path",
+	"output"
+};
+
+// All of these are updated with atomic builtins, because with multiple roots
+// the allocations come from several threads at once.  Everything here is
+// zero-initialized before any code runs, so the counting works even for
+// allocations made by static constructors.
+
+StageStats stats[ STAGE_COUNT ];
+volatile int current_stage;
+unsigned long in_use;              // Usable bytes currently allocated
+
+/* ---------------------------------------------------------------------------------
+   Record an allocation or a free.  We track bytes in use by malloc_usable_size(),
+   because that's what we can know at free() time.
+   ------------------------------------------------------------------------------ */
+void raise_peak( StageStats & s, unsigned long now )
+{
+	unsigned long peak = s.peak;
+	while( now > peak )
+	{
+		unsigned long prev = __sync_val_compare_and_swap( &s.peak, peak, now );
+		if( prev == peak )
+			break;
+		peak = prev;
+	}
+}
+
+void note_alloc( void * p, size_t requested )
+{
+	if( NULL == p )
+		return;
+
+	StageStats & s = stats[ current_stage ];
+	__sync_fetch_and_add( &s.allocs, 1UL );
+	__sync_fetch_and_add( &s.bytes, static_cast< unsigned long >( requested ) );
+	raise_peak( s, __sync_add_and_fetch( &in_use,
+		static_cast< unsigned long >( malloc_usable_size( p ) ) ) );
+}
+
+void note_free( void * p )
+{
+	if( NULL == p )
+		return;
+
+	__sync_fetch_and_add( &stats[ current_stage ].frees, 1UL );
+	__sync_fetch_and_sub( &in_use, static_cast< unsigned long >( malloc_usable_size( p ) ) );
+}
+
+/* ---------------------------------------------------------------------------------
+   Write the report to standard error, one line per stage, unless it has already
+   been written.  Use snprintf() and write() so that the report itself doesn't
+   allocate anything.
+   ------------------------------------------------------------------------------ */
+void write_report()
+{
+	static bool written = false;
+	if( written )
+		return;
+	written = true;
+
+	char buf[ 160 ];
+	int len = snprintf( buf, sizeof buf, "%-12s %10s %10s %12s %12s\n",
+		"stage", "allocs", "frees", "bytes", "peak" );
+	ssize_t rc = write( STDERR_FILENO, buf, len );
+
+	for( int i = 0; i < STAGE_COUNT && rc >= 0; ++i )
+	{
+		len = snprintf( buf, sizeof buf, "%-12s %10lu %10lu %12lu %12lu\n",
+			stage_names[ i ], stats[ i ].allocs, stats[ i ].frees,
+			stats[ i ].bytes, stats[ i ].peak );
+		rc = write( STDERR_FILENO, buf, len );
+	}
+}
+
+// Writes the report when static objects are destroyed, i.e. after main()
+// returns or exit() is called.
+
+struct Reporter
+{
+	~Reporter() { write_report(); }
+} reporter;
+
+}  // namespace
+
+void alloc_report()
+{
+	write_report();
+}
+
+void alloc_stage( AllocStage stage )
+{
+	// Whatever is still allocated when a stage begins counts toward its peak.
+
+	current_stage = stage;
+	raise_peak( stats[ stage ], __sync_add_and_fetch( &in_use, 0UL ) );
+}
+
+/* ---- Replacements for the C library allocator ---- */
+
+extern "C"
+{
+
+void * malloc( size_t size )
+{
+	void * p = __libc_malloc( size );
+	note_alloc( p, size );
+	return p;
+}
+
+void * calloc( size_t count, size_t size )
+{
+	void * p = __libc_calloc( count, size );
+	note_alloc( p, count * size );
+	return p;
+}
+
+void * realloc( void * old, size_t size )
+{
+	// Count a realloc() as a free plus an allocation, whether or not the
+	// block moves.  Note the old block before it goes away.
+
+	if( old )
+		note_free( old );
+	void * p = __libc_realloc( old, size );
+	if( NULL == p && old && size )
+		note_alloc( old, malloc_usable_size( old ) );   // Failed; old block survives
+	else
+		note_alloc( p, size );
+	return p;
+}
+
+void * memalign( size_t alignment, size_t size )
+{
+	void * p = __libc_memalign( alignment, size );
+	note_alloc( p, size );
+	return p;
+}
+
+int posix_memalign( void ** result, size_t alignment, size_t size )
+{
+	if( 0 == alignment || ( alignment & ( alignment - 1 ) ) || alignment % sizeof( void * ) )
+		return EINVAL;
+
+	void * p = __libc_memalign( alignment, size );
+	if( NULL == p )
+		return ENOMEM;
+	note_alloc( p, size );
+	*result = p;
+	return 0;
+}
+
+void * aligned_alloc( size_t alignment, size_t size )
+{
+	void * p = __libc_memalign( alignment, size );
+	note_alloc( p, size );
+	return p;
+}
+
+void * valloc( size_t size )
+{
+	void * p = __libc_valloc( size );
+	note_alloc( p, size );
+	return p;
+}
+
+void * pvalloc( size_t size )
+{
+	void * p = __libc_pvalloc( size );
+	note_alloc( p, size );
+	return p;
+}
+
+void free( void * p )
+{
+	note_free( p );
+	__libc_free( p );
+}
+
+}  // extern "C"
+
+/* ---- Replacements for the global operator new and delete ---- */
+
+// These route through our malloc() and free(), so every allocation is counted
+// once, whichever interface it came through.
+
+void * operator new( size_t size ) throw( std::bad_alloc )
+{
+	void * p = malloc( size ? size : 1 );
+	if( NULL == p )
+		throw std::bad_alloc();
+	return p;
+}
+
+void * operator new[]( size_t size ) throw( std::bad_alloc )
+{
+	return operator new( size );
+}
+
+void * operator new( size_t size, const std::nothrow_t & ) throw()
+{
+	return malloc( size ? size : 1 );
+}
+
+void * operator new[]( size_t size, const std::nothrow_t & ) throw()
+{
+	return malloc( size ? size : 1 );
+}
+
+void operator delete( void * p ) throw()
+{
+	free( p );
+}
+
+void operator delete[]( void * p ) throw()
+{
+	free( p );
+}
+
+void operator delete( void * p, const std::nothrow_t & ) throw()
+{
+	free( p );
+}
+
+void operator delete[]( void * p, const std::nothrow_t & ) throw()
+{
+	free( p );
+}
@@ -0,0 +1,49 @@
+/*
+    alloc_stats.h -- declarations for the allocation accounting build: counts of heap
+    allocations, charged to the stage of the program that was running when they
+    happened.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+enum AllocStage
+{
+	STAGE_STARTUP,                 // Before main() gets going, and anything unmarked
+	STAGE_GET_OPTS,
+	STAGE_PARSE_PATH,
+	STAGE_BUILD_PATH,
+	STAGE_OUTPUT,
+	STAGE_COUNT
+};
+
+// In the instrumented build (compiled with ALLOC_STATS defined, and linked with
+// alloc_stats.o), alloc_stage() charges subsequent allocations to the specified
+// stage, and a report goes to standard error at exit.  Otherwise it does nothing.
+// A program that leaves with _exit() calls alloc_report() first, since static
+// destructors don't run then.
+
+#ifdef ALLOC_STATS
+void alloc_stage( AllocStage stage );
+void alloc_report();
+#else
+inline void alloc_stage( AllocStage ) {}
+inline void alloc_report() {}
+#endif
+
+#endif
@@ -0,0 +1,221 @@
+/*
+    dedup.cpp -- remove duplicates from a long list of path list entries with
+    several threads, keeping the first occurrence of each.
+
+    The work goes in three passes over the list, each split into chunks that the
+    threads take in turn:
+
+    1. Insert every entry into a shared open-addressing hash table.  A slot holds
+       the index (plus one) of an entry, and once claimed it only ever holds
+       indexes of equal entries: an entry that finds its equal already there
+       lowers the slot to its own index if that is smaller, with compare-and-swap.
+       When the pass is over, each slot holds the first position of its entry.
+    2. Mark each entry that is the one its slot holds, and count the marks in
+       each chunk.
+    3. From the counts of the chunks before it, each chunk knows where its
+       survivors go, and copies them there.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#include "dedup.h"
+#include <pthread.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace std {}
+using namespace std;
+
+static const size_t CHUNKS_PER_THREAD = 4;   // For balancing uneven chunks
+
+enum DedupPass
+{
+	PASS_INSERT,
+	PASS_MARK,
+	PASS_COPY
+};
+
+struct DedupWork
+{
+	const PathEntry * in;
+	size_t count;
+	PathEntry * out;
+	size_t chunk_size;
+	size_t chunk_count;
+	DedupPass pass;
+	size_t next_chunk;                  // Next chunk to take, shared by the threads
+	vector< uint32_t > slots;           // Index + 1 of the first occurrence, or 0
+	size_t mask;
+	vector< uint32_t > slot_of;         // Each entry's slot
+	vector< unsigned char > keep;       // Whether each entry survives
+	vector< size_t > kept;              // Survivors in each chunk
+};
+
+static void * dedup_worker( void * arg );
+static void insert_chunk( DedupWork & work, size_t begin, size_t end );
+static void run_pass( DedupWork & work, DedupPass pass, size_t thread_count );
+
+size_t parallel_dedup( const PathEntry * in, size_t count, size_t thread_count,
+	PathEntry * out )
+{
+	// Slots and entry indexes are 32 bits.  The table may have twice as many
+	// slots as there are entries, rounded up to a power of 2, so this limit
+	// keeps every slot index within 32 bits too.
+
+	if( count > UINT32_MAX / 2 )
+		throw runtime_error( string( "Too many entries to remove duplicates from" ) );
+	if( thread_count < 1 )
+		thread_count = 1;
+
+	DedupWork work;
+	work.in = in;
+	work.count = count;
+	work.out = out;
+	work.chunk_count = thread_count * CHUNKS_PER_THREAD;
+	work.chunk_size = ( count + work.chunk_count - 1 ) / work.chunk_count;
+	if( 0 == work.chunk_size )
+		work.chunk_size = 1;
+	work.chunk_count = ( count + work.chunk_size - 1 ) / work.chunk_size;
+
+	// Keep the table at most half full, as EntrySet does
+
+	size_t table_size = 64;
+	while( table_size < 2 * count )
+		table_size *= 2;
+	work.slots.resize( table_size, 0 );
+	work.mask = table_size - 1;
+	work.slot_of.resize( count );
+	work.keep.resize( count );
+	work.kept.resize( work.chunk_count );
+
+	run_pass( work, PASS_INSERT, thread_count );
+	run_pass( work, PASS_MARK, thread_count );
+	run_pass( work, PASS_COPY, thread_count );
+
+	size_t total = 0;
+	for( size_t c = 0; c < work.chunk_count; ++c )
+		total += work.kept[ c ];
+	return total;
+}
+
+/* ---------------------------------------------------------------------------------
+   Run one pass with up to thread_count threads, including this one.  If a thread
+   can't be started, the others take its chunks.
+   ------------------------------------------------------------------------------ */
+static void run_pass( DedupWork & work, DedupPass pass, size_t thread_count )
+{
+	work.pass = pass;
+	work.next_chunk = 0;
+
+	vector< pthread_t > threads;
+	for( size_t i = 1; i < thread_count; ++i )
+	{
+		pthread_t thread;
+		if( 0 != pthread_create( &thread, NULL, dedup_worker, &work ) )
+			break;
+		threads.push_back( thread );
+	}
+
+	dedup_worker( &work );
+
+	for( size_t i = 0; i < threads.size(); ++i )
+		pthread_join( threads[ i ], NULL );
+}
+
+static void * dedup_worker( void * arg )
+{
+	DedupWork & work = *static_cast< DedupWork * >( arg );
+
+	for( ;; )
+	{
+		size_t c = __sync_fetch_and_add( &work.next_chunk, 1 );
+		if( c >= work.chunk_count )
+			break;
+
+		size_t begin = c * work.chunk_size;
+		size_t end = begin + work.chunk_size;
+		if( end > work.count )
+			end = work.count;
+
+		if( PASS_INSERT == work.pass )
+			insert_chunk( work, begin, end );
+		else if( PASS_MARK == work.pass )
+		{
+			size_t kept = 0;
+			for( size_t i = begin; i < end; ++i )
+			{
+				work.keep[ i ] = work.slots[ work.slot_of[ i ] ] == i + 1;
+				kept += work.keep[ i ];
+			}
+			work.kept[ c ] = kept;
+		}
+		else
+		{
+			size_t pos = 0;
+			for( size_t prev = 0; prev < c; ++prev )
+				pos += work.kept[ prev ];
+			for( size_t i = begin; i < end; ++i )
+			{
+				if( work.keep[ i ] )
+					work.out[ pos++ ] = work.in[ i ];
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/* ---------------------------------------------------------------------------------
+   Add a range of entries to the shared table, leaving in each slot the lowest
+   index of the entries that hash to it and are equal.
+   ------------------------------------------------------------------------------ */
+static void insert_chunk( DedupWork & work, size_t begin, size_t end )
+{
+	uint32_t * slots = &work.slots[ 0 ];
+
+	for( size_t i = begin; i < end; ++i )
+	{
+		const PathEntry & entry = work.in[ i ];
+		uint32_t mine = static_cast< uint32_t >( i + 1 );
+
+		// Same hash as the serial pass
+		size_t s = EntrySet< 64 >::hash( entry ) & work.mask;
+		for( ;; )
+		{
+			uint32_t held = __sync_val_compare_and_swap( &slots[ s ], 0, mine );
+			if( 0 == held )
+				break;   // Claimed an empty slot
+
+			if( work.in[ held - 1 ] == entry )
+			{
+				// Take the slot over while ours is the earlier occurrence
+				while( mine < held )
+				{
+					uint32_t seen = __sync_val_compare_and_swap( &slots[ s ], held, mine );
+					if( seen == held )
+						break;
+					held = seen;
+				}
+				break;
+			}
+
+			s = ( s + 1 ) & work.mask;
+		}
+
+		work.slot_of[ i ] = static_cast< uint32_t >( s );
+	}
+}
@@ -0,0 +1,36 @@
+/*
+    dedup.h -- declarations for removing duplicates from a long list of path list
+    entries with several threads.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stddef.h>
+#include "smallbuf.h"
+
+/* ---------------------------------------------------------------------------------
+   Copy the first occurrence of each distinct entry in in[ 0 .. count ) to out, in
+   their original order, and return the number copied.  The result is the same as
+   that of the serial keep-first pass; it's just computed with up to thread_count
+   threads.  out must have room for count entries, and must not overlap in.
+   ------------------------------------------------------------------------------ */
+size_t parallel_dedup( const PathEntry * in, size_t count, size_t thread_count,
+	PathEntry * out );
+
+#endif
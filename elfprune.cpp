@@ -0,0 +1,491 @@
+/*
+    elfprune.cpp -- prune a library search path, such as LD_LIBRARY_PATH, down to the
+    directories that the dynamic loader would actually use for a given set of binaries.
+
+    The dynamic loader searches every directory of LD_LIBRARY_PATH, in order, for every
+    DT_NEEDED library that it hasn't found yet.  A directory that never supplies a
+    library costs a failed probe for each library found after it.  We read the
+    DT_NEEDED entries of each binary, find each library the way the loader would, and
+    recurse into the libraries we find.  A directory survives only if it supplies at
+    least one library.  Since a discarded directory never held a usable copy of any
+    library, discarding it doesn't change which copy the loader picks.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#include "elfprune.h"
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <deque>
+#include <set>
+#include <elf.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace std {}
+using namespace std;
+
+// What we need to know about an ELF object:
+struct ElfInfo
+{
+	unsigned char elf_class;       // ELFCLASS32 or ELFCLASS64
+	unsigned short machine;        // e_machine
+	vector< string > needed;       // DT_NEEDED entries
+	vector< string > rpath;        // DT_RPATH directories, with $ORIGIN expanded
+	vector< string > runpath;      // DT_RUNPATH directories, with $ORIGIN expanded
+	bool has_runpath;              // If true, the loader ignores DT_RPATH
+};
+
+// Where a needed library was found, for counting probes:
+static const size_t NOT_IN_LIST = static_cast< size_t >( -1 );
+
+static bool read_elf( const string & filename, ElfInfo & info );
+static bool is_compatible( const string & filename, const ElfInfo & requester );
+static void load_system_dirs( vector< string > & dirs );
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+static const unsigned char NATIVE_DATA = ELFDATA2LSB;
+#else
+static const unsigned char NATIVE_DATA = ELFDATA2MSB;
+#endif
+
+/* ---------------------------------------------------------------------------------
+   Split a DT_RPATH or DT_RUNPATH string into directories, replacing $ORIGIN with
+   the directory containing the object.  Drop directories that use other dynamic
+   string tokens, which we can't expand reliably.
+   ------------------------------------------------------------------------------ */
+static void split_search_path( const char * str, const string & origin, vector< string > & dirs )
+{
+	string dir;
+	for( const char * p = str; ; ++p )
+	{
+		if( *p && *p != ':' )
+		{
+			dir += *p;
+			continue;
+		}
+
+		string::size_type pos;
+		while( ( pos = dir.find( "${ORIGIN}" ) ) != string::npos )
+			dir.replace( pos, 9, origin );
+		while( ( pos = dir.find( "$ORIGIN" ) ) != string::npos )
+			dir.replace( pos, 7, origin );
+
+		if( ! dir.empty() && string::npos == dir.find( '$' ) )
+			dirs.push_back( dir );
+		dir.clear();
+
+		if( ! *p )
+			break;
+	}
+}
+
+/* ---------------------------------------------------------------------------------
+   Translate a virtual address into a file offset, using the PT_LOAD segments.
+   Return false if no segment maps it.
+   ------------------------------------------------------------------------------ */
+template< typename Phdr >
+static bool vaddr_to_offset( const Phdr * phdrs, size_t count, uint64_t vaddr, uint64_t & offset )
+{
+	for( size_t i = 0; i < count; ++i )
+	{
+		const Phdr & ph = phdrs[ i ];
+		if( PT_LOAD == ph.p_type && vaddr >= ph.p_vaddr && vaddr < ph.p_vaddr + ph.p_filesz )
+		{
+			offset = vaddr - ph.p_vaddr + ph.p_offset;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* ---------------------------------------------------------------------------------
+   Extract the dynamic section entries that we care about from a mapped ELF file of
+   one class or the other.  Every offset comes from the file, so check each one
+   against the size of the file before using it.
+   ------------------------------------------------------------------------------ */
+template< typename Ehdr, typename Phdr, typename Dyn >
+static bool parse_dynamic( const unsigned char * base, size_t size, const string & origin,
+	ElfInfo & info )
+{
+	if( size < sizeof( Ehdr ) )
+		return false;
+
+	const Ehdr * eh = reinterpret_cast< const Ehdr * >( base );
+	if( eh->e_phentsize != sizeof( Phdr ) ||
+		eh->e_phoff > size || eh->e_phnum * sizeof( Phdr ) > size - eh->e_phoff )
+		return false;
+
+	info.machine = eh->e_machine;
+
+	const Phdr * phdrs = reinterpret_cast< const Phdr * >( base + eh->e_phoff );
+	size_t phnum = eh->e_phnum;
+
+	const Dyn * dyn = NULL;
+	size_t dyn_count = 0;
+	for( size_t i = 0; i < phnum; ++i )
+	{
+		if( PT_DYNAMIC == phdrs[ i ].p_type )
+		{
+			if( phdrs[ i ].p_offset > size || phdrs[ i ].p_filesz > size - phdrs[ i ].p_offset )
+				return false;
+			dyn = reinterpret_cast< const Dyn * >( base + phdrs[ i ].p_offset );
+			dyn_count = phdrs[ i ].p_filesz / sizeof( Dyn );
+			break;
+		}
+	}
+
+	if( NULL == dyn )
+		return true;   // Statically linked; needs nothing
+
+	uint64_t strtab_addr = 0;
+	uint64_t strsz = 0;
+	vector< uint64_t > needed_offs;
+	uint64_t rpath_off = 0;
+	uint64_t runpath_off = 0;
+	bool has_rpath = false;
+	info.has_runpath = false;
+
+	for( size_t i = 0; i < dyn_count && dyn[ i ].d_tag != DT_NULL; ++i )
+	{
+		switch( dyn[ i ].d_tag )
+		{
+			case DT_NEEDED :
+				needed_offs.push_back( dyn[ i ].d_un.d_val );
+				break;
+			case DT_STRTAB :
+				strtab_addr = dyn[ i ].d_un.d_ptr;
+				break;
+			case DT_STRSZ :
+				strsz = dyn[ i ].d_un.d_val;
+				break;
+			case DT_RPATH :
+				rpath_off = dyn[ i ].d_un.d_val;
+				has_rpath = true;
+				break;
+			case DT_RUNPATH :
+				runpath_off = dyn[ i ].d_un.d_val;
+				info.has_runpath = true;
+				break;
+			default :
+				break;
+		}
+	}
+
+	uint64_t strtab;
+	if( ! vaddr_to_offset( phdrs, phnum, strtab_addr, strtab ) || strtab > size )
+		return false;
+	if( strsz > size - strtab )
+		strsz = size - strtab;
+
+	const char * strs = reinterpret_cast< const char * >( base + strtab );
+	const char * strs_end = strs + strsz;
+
+	for( size_t i = 0; i < needed_offs.size(); ++i )
+	{
+		if( needed_offs[ i ] >= strsz )
+			return false;
+		const char * name = strs + needed_offs[ i ];
+		const char * nul = static_cast< const char * >( memchr( name, '\0', strs_end - name ) );
+		if( NULL == nul )
+			return false;
+		info.needed.push_back( string( name, nul ) );
+	}
+
+	if( has_rpath && rpath_off < strsz && memchr( strs + rpath_off, '\0', strsz - rpath_off ) )
+		split_search_path( strs + rpath_off, origin, info.rpath );
+	if( info.has_runpath && runpath_off < strsz &&
+		memchr( strs + runpath_off, '\0', strsz - runpath_off ) )
+		split_search_path( strs + runpath_off, origin, info.runpath );
+
+	return true;
+}
+
+/* ---------------------------------------------------------------------------------
+   Read an ELF file.  Return false if it can't be read, or isn't an ELF file in our
+   byte order.
+   ------------------------------------------------------------------------------ */
+static bool read_elf( const string & filename, ElfInfo & info )
+{
+	info.needed.clear();
+	info.rpath.clear();
+	info.runpath.clear();
+	info.has_runpath = false;
+
+	int fd = open( filename.c_str(), O_RDONLY | O_CLOEXEC );
+	if( fd < 0 )
+		return false;
+
+	struct stat st;
+	if( fstat( fd, &st ) != 0 || ! S_ISREG( st.st_mode ) || st.st_size < EI_NIDENT )
+	{
+		close( fd );
+		return false;
+	}
+
+	void * addr = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if( MAP_FAILED == addr )
+		return false;
+
+	const unsigned char * base = static_cast< const unsigned char * >( addr );
+	size_t size = st.st_size;
+
+	string origin( filename, 0, filename.rfind( '/' ) == string::npos ? 0 : filename.rfind( '/' ) );
+	if( origin.empty() )
+		origin = filename.at( 0 ) == '/' ? "/" : ".";
+
+	bool ok = false;
+	if( 0 == memcmp( base, ELFMAG, SELFMAG ) && NATIVE_DATA == base[ EI_DATA ] )
+	{
+		info.elf_class = base[ EI_CLASS ];
+		if( ELFCLASS64 == info.elf_class )
+			ok = parse_dynamic< Elf64_Ehdr, Elf64_Phdr, Elf64_Dyn >( base, size, origin, info );
+		else if( ELFCLASS32 == info.elf_class )
+			ok = parse_dynamic< Elf32_Ehdr, Elf32_Phdr, Elf32_Dyn >( base, size, origin, info );
+	}
+
+	munmap( addr, size );
+	return ok;
+}
+
+/* ---------------------------------------------------------------------------------
+   Return true if a file is an ELF object that the loader could use to satisfy a
+   dependency of the requester, i.e. one of the same class and machine.  The
+   loader skips incompatible files and keeps searching, and so do we.
+   ------------------------------------------------------------------------------ */
+static bool is_compatible( const string & filename, const ElfInfo & requester )
+{
+	int fd = open( filename.c_str(), O_RDONLY | O_CLOEXEC );
+	if( fd < 0 )
+		return false;
+
+	Elf64_Ehdr eh;   // Large enough for either class, as far as we look
+	ssize_t n = read( fd, &eh, sizeof eh );
+	close( fd );
+
+	if( n < static_cast< ssize_t >( sizeof( Elf32_Ehdr ) ) ||
+		memcmp( eh.e_ident, ELFMAG, SELFMAG ) != 0 ||
+		eh.e_ident[ EI_CLASS ] != requester.elf_class || eh.e_ident[ EI_DATA ] != NATIVE_DATA )
+		return false;
+
+	// e_machine is at the same offset in both classes
+	return eh.e_machine == requester.machine;
+}
+
+/* ---------------------------------------------------------------------------------
+   Search a list of directories for a compatible copy of a library.  Return the
+   index of the first directory that has one, or NOT_IN_LIST.
+   ------------------------------------------------------------------------------ */
+static size_t search_dirs( const vector< string > & dirs, const string & soname,
+	const ElfInfo & requester, string & found )
+{
+	for( size_t i = 0; i < dirs.size(); ++i )
+	{
+		string candidate( dirs[ i ] );
+		candidate += '/';
+		candidate += soname;
+		if( is_compatible( candidate, requester ) )
+		{
+			found = candidate;
+			return i;
+		}
+	}
+
+	return NOT_IN_LIST;
+}
+
+/* ---------------------------------------------------------------------------------
+   Read a configuration file in the format of /etc/ld.so.conf, following "include"
+   directives, and append the directories it names.
+   ------------------------------------------------------------------------------ */
+static void read_ld_conf( const char * filename, vector< string > & dirs, int depth )
+{
+	FILE * fp = fopen( filename, "r" );
+	if( NULL == fp || depth > 8 )
+	{
+		if( fp )
+			fclose( fp );
+		return;
+	}
+
+	char line[ 4096 ];
+	while( fgets( line, sizeof line, fp ) )
+	{
+		char * hash = strchr( line, '#' );
+		if( hash )
+			*hash = '\0';
+
+		char * p = line + strspn( line, " \t\r\n" );
+		char * end = p + strcspn( p, " \t\r\n" );
+		if( p == end )
+			continue;
+
+		if( 0 == strncmp( p, "include", 7 ) && ( ' ' == p[ 7 ] || '\t' == p[ 7 ] ) )
+		{
+			p += 8;
+			p += strspn( p, " \t" );
+			p[ strcspn( p, " \t\r\n" ) ] = '\0';
+
+			glob_t g;
+			if( 0 == glob( p, 0, NULL, &g ) )
+			{
+				for( size_t i = 0; i < g.gl_pathc; ++i )
+					read_ld_conf( g.gl_pathv[ i ], dirs, depth + 1 );
+			}
+			globfree( &g );
+		}
+		else if( '/' == *p )
+			dirs.push_back( string( p, end ) );
+	}
+
+	fclose( fp );
+}
+
+/* ---------------------------------------------------------------------------------
+   Load the directories that the loader searches after LD_LIBRARY_PATH.  The loader
+   really consults its cache, which is built from the same configuration.
+   ------------------------------------------------------------------------------ */
+static void load_system_dirs( vector< string > & dirs )
+{
+	dirs.clear();
+	read_ld_conf( "/etc/ld.so.conf", dirs, 0 );
+
+	static const char * const defaults[] = { "/lib64", "/usr/lib64", "/lib", "/usr/lib", NULL };
+	for( const char * const * p = defaults; *p; ++p )
+		dirs.push_back( *p );
+}
+
+/* ---------------------------------------------------------------------------------
+   Prune dir_vec, a library search path in the loader's order, down to the
+   directories that supply at least one library needed by one of the binaries, or by
+   the libraries they need, recursively.  Load the survivors into kept, in their
+   original order, and tally the loader's probes of dir_vec before and after.
+   ------------------------------------------------------------------------------ */
+void prune_lib_path( const vector< string > & dir_vec, const vector< const char * > & binaries,
+	vector< string > & kept, ElfPruneStats & stats )
+{
+	vector< string > system_dirs;
+	load_system_dirs( system_dirs );
+
+	vector< bool > used( dir_vec.size(), false );
+	vector< size_t > hits;         // For each library looked up, where we found it
+	set< string > all_sonames;
+
+	for( size_t b = 0; b < binaries.size(); ++b )
+	{
+		ElfInfo exe;
+		if( ! read_elf( binaries[ b ], exe ) )
+		{
+			string msg( "Unable to read ELF file \"" );
+			msg += binaries[ b ];
+			msg += "\"";
+			throw runtime_error( msg );
+		}
+
+		// Each process loads a given library only once, so each binary has its own
+		// set of libraries already found.  Walk its dependencies breadth first, as
+		// the loader does.
+
+		set< string > loaded;
+		deque< pair< string, ElfInfo > > queue;   // Library name, and who needs it
+		for( size_t i = 0; i < exe.needed.size(); ++i )
+			queue.push_back( make_pair( exe.needed[ i ], exe ) );
+
+		while( ! queue.empty() )
+		{
+			string soname = queue.front().first;
+			ElfInfo requester = queue.front().second;
+			queue.pop_front();
+
+			if( ! loaded.insert( soname ).second )
+				continue;
+			all_sonames.insert( soname );
+
+			string found;
+			if( string::npos != soname.find( '/' ) )
+				found = soname;   // Loaded by path; no search at all
+			else
+			{
+				// DT_RPATH applies only if there is no DT_RUNPATH; then
+				// LD_LIBRARY_PATH; then DT_RUNPATH, and the system directories.
+
+				bool via_rpath = false;
+				if( ! requester.has_runpath )
+					via_rpath =
+						NOT_IN_LIST != search_dirs( requester.rpath, soname, requester, found ) ||
+						( ! exe.has_runpath &&
+						NOT_IN_LIST != search_dirs( exe.rpath, soname, requester, found ) );
+
+				if( ! via_rpath )
+				{
+					size_t where = search_dirs( dir_vec, soname, requester, found );
+					hits.push_back( where );
+					if( where != NOT_IN_LIST )
+						used[ where ] = true;
+					else if( NOT_IN_LIST == search_dirs( requester.runpath, soname,
+						requester, found ) )
+						search_dirs( system_dirs, soname, requester, found );
+				}
+			}
+
+			ElfInfo lib;
+			if( ! found.empty() && read_elf( found, lib ) )
+			{
+				for( size_t i = 0; i < lib.needed.size(); ++i )
+					queue.push_back( make_pair( lib.needed[ i ], lib ) );
+			}
+		}
+	}
+
+	// Keep the directories that supplied something, and count probes.  A library
+	// found in directory i costs one probe for each directory up to and including
+	// i; a library not found costs one for every directory.
+
+	kept.clear();
+	vector< size_t > kept_before( dir_vec.size() + 1, 0 );   // Kept dirs in [0, i)
+	for( size_t i = 0; i < dir_vec.size(); ++i )
+	{
+		kept_before[ i + 1 ] = kept_before[ i ];
+		if( used[ i ] )
+		{
+			kept.push_back( dir_vec[ i ] );
+			++kept_before[ i + 1 ];
+		}
+	}
+
+	stats.sonames = all_sonames.size();
+	stats.probes_before = 0;
+	stats.probes_after = 0;
+	for( size_t i = 0; i < hits.size(); ++i )
+	{
+		if( NOT_IN_LIST == hits[ i ] )
+		{
+			stats.probes_before += dir_vec.size();
+			stats.probes_after += kept.size();
+		}
+		else
+		{
+			stats.probes_before += hits[ i ] + 1;
+			stats.probes_after += kept_before[ hits[ i ] + 1 ];
+		}
+	}
+}
@@ -0,0 +1,40 @@
+/*
+    elfprune.h -- declarations for pruning a library search path down to the directories
+    that the dynamic loader actually needs for a given set of binaries.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#ifndef ELFPRUNE_H
+#define ELFPRUNE_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Statistics from prune_lib_path():
+struct ElfPruneStats
+{
+	size_t sonames;                // Distinct libraries needed, over all binaries
+	size_t probes_before;          // Loader probes in the search path, before pruning
+	size_t probes_after;           // Loader probes in the search path, after pruning
+};
+
+void prune_lib_path( const std::vector< std::string > & dir_vec,
+	const std::vector< const char * > & binaries,
+	std::vector< std::string > & kept, ElfPruneStats & stats );
+
+#endif
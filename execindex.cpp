@@ -0,0 +1,217 @@
+/*
+    execindex.cpp -- a library for LD_PRELOAD that speeds up execvp() and friends by
+    looking commands up in an executable index (see pathindex.h) instead of trying
+    each directory of PATH in turn.
+
+    Build an index with "catpath -i FILE ..." and point $CATPATH_INDEX at it.  The
+    library intercepts execvp(), execvpe(), execlp() and posix_spawnp().  For a
+    command name without a slash, it uses the index only if all of these hold:
+
+    - the index is intact, and was built from exactly the current value of PATH;
+    - the path list has no relative entries, whose meaning depends on the current
+      directory (such an index is never used);
+    - the index lists the command; and
+    - the directory where the index found it, and every directory before that one
+      in PATH, still has the modification time, device and inode recorded in the
+      index, so that no command has been added, removed or renamed in any of them.
+
+    Then it execs the full path directly.  Otherwise, or if that exec fails, it
+    hands the call to the C library unchanged.  The directories are checked again
+    for every lookup, since a long-lived process such as make may install commands
+    between one exec and the next; that costs one stat() per directory up to the
+    one holding the command, where the C library would try an execve() in each.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#include "pathindex.h"
+#include <alloca.h>
+#include <cerrno>
+#include <climits>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern char ** environ;
+
+namespace
+{
+
+PathIndex index;
+bool usable = false;               // True if the index loaded and is for this PATH
+
+int ( *real_execvp )( const char *, char * const [] );
+int ( *real_execvpe )( const char *, char * const [], char * const [] );
+int ( *real_posix_spawnp )( pid_t *, const char *, const posix_spawn_file_actions_t *,
+	const posix_spawnattr_t *, char * const [], char * const [] );
+
+template< typename Fn >
+void next_symbol( Fn & fn, const char * name )
+{
+	void * sym = dlsym( RTLD_NEXT, name );
+	memcpy( &fn, &sym, sizeof fn );
+}
+
+/* ---------------------------------------------------------------------------------
+   Load the index when the library is loaded, rather than at the first exec, which
+   may happen in the child of a vfork().
+   ------------------------------------------------------------------------------ */
+__attribute__(( constructor )) void load_index()
+{
+	next_symbol( real_execvp, "execvp" );
+	next_symbol( real_execvpe, "execvpe" );
+	next_symbol( real_posix_spawnp, "posix_spawnp" );
+
+	const char * filename = getenv( "CATPATH_INDEX" );
+	if( NULL == filename || ! open_index( filename, index, true ) )
+		return;
+
+	if( index.header->flags & INDEX_RELATIVE )
+	{
+		close_index( index );
+		return;
+	}
+
+	usable = true;
+}
+
+// Return true if the index was built from the current PATH.
+bool same_path()
+{
+	const char * path = getenv( "PATH" );
+	if( NULL == path )
+		return false;
+
+	const IndexHeader & h = *index.header;
+	return strlen( path ) == h.path_length &&
+		0 == memcmp( path, index_string( index, h.path_offset ), h.path_length );
+}
+
+// Return true if a directory in the index hasn't changed since it was indexed.
+bool dir_unchanged( uint32_t i )
+{
+	const IndexDir * dir = index_dir( index, i );
+	char dirname[ PATH_MAX ];
+	if( dir->path_length >= sizeof dirname )
+		return false;
+
+	memcpy( dirname, index_string( index, dir->path_offset ), dir->path_length );
+	dirname[ dir->path_length ] = '\0';
+
+	struct stat st;
+	return 0 == stat( dirname, &st ) &&
+		st.st_mtim.tv_sec == dir->mtime_sec && st.st_mtim.tv_nsec == dir->mtime_nsec &&
+		st.st_dev == dir->dev && st.st_ino == dir->ino;
+}
+
+/* ---------------------------------------------------------------------------------
+   Find the full path of a command with the index, into a buffer of PATH_MAX bytes.
+   Return false if we can't vouch for the answer.
+   ------------------------------------------------------------------------------ */
+bool resolve( const char * file, char * full )
+{
+	if( ! usable || NULL == file || '\0' == *file || strchr( file, '/' ) || ! same_path() )
+		return false;
+
+	size_t len = strlen( file );
+	const IndexRecord * rec = lookup_index( index, file, len );
+	if( NULL == rec )
+		return false;
+
+	for( uint32_t i = 0; i <= rec->dir; ++i )
+	{
+		if( ! dir_unchanged( i ) )
+			return false;
+	}
+
+	const IndexDir * dir = index_dir( index, rec->dir );
+	if( dir->path_length + 1 + len >= PATH_MAX )
+		return false;
+
+	memcpy( full, index_string( index, dir->path_offset ), dir->path_length );
+	full[ dir->path_length ] = '/';
+	memcpy( full + dir->path_length + 1, file, len + 1 );
+	return true;
+}
+
+}  // namespace
+
+extern "C"
+{
+
+int execvpe( const char * file, char * const argv[], char * const envp[] )
+{
+	char full[ PATH_MAX ];
+	if( resolve( file, full ) )
+	{
+		int saved = errno;
+		execve( full, argv, envp );
+		errno = saved;   // Fall back for anything unusual, e.g. ENOEXEC
+	}
+
+	return real_execvpe( file, argv, envp );
+}
+
+int execvp( const char * file, char * const argv[] )
+{
+	char full[ PATH_MAX ];
+	if( resolve( file, full ) )
+	{
+		int saved = errno;
+		execve( full, argv, environ );
+		errno = saved;
+	}
+
+	return real_execvp( file, argv );
+}
+
+int execlp( const char * file, const char * arg, ... )
+{
+	// Collect the arguments into an array on the stack, as the C library does,
+	// since we may be in the child of a vfork() and shouldn't call malloc().
+
+	va_list ap;
+	va_start( ap, arg );
+	size_t count = 1;
+	while( va_arg( ap, const char * ) )
+		++count;
+	va_end( ap );
+
+	char ** argv = static_cast< char ** >( alloca( ( count + 1 ) * sizeof( char * ) ) );
+	argv[ 0 ] = const_cast< char * >( arg );
+	va_start( ap, arg );
+	for( size_t i = 1; i <= count; ++i )
+		argv[ i ] = va_arg( ap, char * );
+	va_end( ap );
+
+	return execvp( file, argv );
+}
+
+int posix_spawnp( pid_t * pid, const char * file, const posix_spawn_file_actions_t * actions,
+	const posix_spawnattr_t * attr, char * const argv[], char * const envp[] )
+{
+	char full[ PATH_MAX ];
+	if( resolve( file, full ) && 0 == posix_spawn( pid, full, actions, attr, argv, envp ) )
+		return 0;
+
+	return real_posix_spawnp( pid, file, actions, attr, argv, envp );
+}
+
+}  // extern "C"
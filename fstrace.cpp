@@ -0,0 +1,134 @@
+/*
+    fstrace.cpp -- read and write trace files of directory checks.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#include "fstrace.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace std {}
+using namespace std;
+
+static void put_varint( string & out, uint64_t n )
+{
+	while( n >= 0x80 )
+	{
+		out += static_cast< char >( ( n & 0x7f ) | 0x80 );
+		n >>= 7;
+	}
+	out += static_cast< char >( n );
+}
+
+// Decode a varint starting at pos, and advance pos past it.  Return false if
+// the data runs out first.
+static bool get_varint( const string & in, size_t & pos, uint64_t & n )
+{
+	n = 0;
+	for( unsigned shift = 0; pos < in.size() && shift < 64; shift += 7 )
+	{
+		unsigned char byte = static_cast< unsigned char >( in[ pos++ ] );
+		n |= static_cast< uint64_t >( byte & 0x7f ) << shift;
+		if( ! ( byte & 0x80 ) )
+			return true;
+	}
+	return false;
+}
+
+void write_trace( const char * filename, const vector< TraceEvent > & events )
+{
+	string data( TRACE_MAGIC, sizeof TRACE_MAGIC );
+	data.append( reinterpret_cast< const char * >( &TRACE_VERSION ), sizeof TRACE_VERSION );
+
+	for( size_t i = 0; i < events.size(); ++i )
+	{
+		const TraceEvent & e = events[ i ];
+		put_varint( data, e.key.size() );
+		data += e.key;
+		data += static_cast< char >( e.answer ? 1 : 0 );
+		put_varint( data, e.ns );
+	}
+
+	ofstream out( filename, ios::out | ios::binary | ios::trunc );
+	out.write( data.data(), data.size() );
+	out.close();
+	if( ! out )
+	{
+		string msg( "Unable to write trace file " );
+		msg += filename;
+		throw runtime_error( msg );
+	}
+}
+
+void read_trace( const char * filename, vector< TraceEvent > & events )
+{
+	ifstream in( filename, ios::in | ios::binary );
+	if( ! in )
+	{
+		string msg( "Unable to open trace file " );
+		msg += filename;
+		throw runtime_error( msg );
+	}
+
+	string data;
+	char buf[ 8192 ];
+	while( in.read( buf, sizeof buf ) || in.gcount() > 0 )
+		data.append( buf, in.gcount() );
+
+	uint32_t version = 0;
+	if( data.size() < sizeof TRACE_MAGIC + sizeof version ||
+		0 != memcmp( data.data(), TRACE_MAGIC, sizeof TRACE_MAGIC ) )
+	{
+		string msg( "Not a trace file: " );
+		msg += filename;
+		throw runtime_error( msg );
+	}
+
+	memcpy( &version, data.data() + sizeof TRACE_MAGIC, sizeof version );
+	if( TRACE_VERSION != version )
+	{
+		string msg( "Unsupported version of trace file " );
+		msg += filename;
+		throw runtime_error( msg );
+	}
+
+	size_t pos = sizeof TRACE_MAGIC + sizeof version;
+	bool ok = true;
+	while( ok && pos < data.size() )
+	{
+		TraceEvent e;
+		uint64_t len;
+		ok = get_varint( data, pos, len ) && len < data.size() - pos;
+		if( ok )
+		{
+			e.key.assign( data, pos, len );
+			pos += len;
+			e.answer = 0 != data[ pos++ ];
+			ok = get_varint( data, pos, e.ns );
+		}
+		if( ok )
+			events.push_back( e );
+	}
+
+	if( ! ok )
+	{
+		string msg( "Trace file is truncated or damaged: " );
+		msg += filename;
+		throw runtime_error( msg );
+	}
+}
@@ -0,0 +1,64 @@
+/*
+    fstrace.h -- declarations for trace files: recordings of the directory checks made
+    by a run of catpath, with their answers and how long they took, for replaying
+    later.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#ifndef FSTRACE_H
+#define FSTRACE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+   Layout of a trace file:
+
+       "CATPTRC\0"                 magic
+       uint32_t version            TRACE_VERSION, in native byte order
+       records, to end of file
+
+   Each record is:
+
+       varint key length
+       key                         identifies the query (see below)
+       uint8_t answer              1 if the check passed, 0 if not
+       varint latency              nanoseconds
+
+   where a varint is an unsigned integer in 7-bit groups, least significant
+   first, with the high bit set on every byte but the last.  A typical record
+   takes 20 to 40 bytes.
+
+   The key is opaque to this module; catpath makes it from the check mode, the
+   root, and the directory.
+*/
+
+static const char TRACE_MAGIC[ 8 ] = { 'C', 'A', 'T', 'P', 'T', 'R', 'C', '\0' };
+static const uint32_t TRACE_VERSION = 1;
+
+struct TraceEvent
+{
+	std::string key;
+	bool answer;
+	uint64_t ns;
+};
+
+void write_trace( const char * filename, const std::vector< TraceEvent > & events );
+void read_trace( const char * filename, std::vector< TraceEvent > & events );
+
+#endif
@@ -0,0 +1,325 @@
+/*
+    latency.cpp -- histograms of directory check latency, and a report of the entries,
+    path prefixes and mounts that cost the most.
+
+    A latency file holds one histogram per line: the key, a tab, and a list of
+    BUCKET:COUNT pairs separated by spaces.  Updates lock the file with flock() and
+    rewrite it in place, so that concurrent logins don't lose each other's counts.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#include "latency.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace std {}
+using namespace std;
+
+static const unsigned SUB_BITS = 5;            // 32 buckets per power of two
+static const uint64_t LINEAR_LIMIT = 64;       // Values below this get a bucket each
+
+/* ---------------------------------------------------------------------------------
+   Map a value to its bucket, and a bucket back to a value representative of it
+   (the middle of its range).
+   ------------------------------------------------------------------------------ */
+static uint32_t bucket_of( uint64_t ns )
+{
+	if( ns < LINEAR_LIMIT )
+		return static_cast< uint32_t >( ns );
+
+	unsigned e = 63 - __builtin_clzll( ns );  // Position of the top bit, at least 6
+	uint64_t sub = ( ns >> ( e - SUB_BITS ) ) & ( ( 1u << SUB_BITS ) - 1 );
+	return static_cast< uint32_t >( LINEAR_LIMIT + ( e - 6 ) * ( 1u << SUB_BITS ) + sub );
+}
+
+static double value_of( uint32_t bucket )
+{
+	if( bucket < LINEAR_LIMIT )
+		return bucket;
+
+	uint32_t n = bucket - LINEAR_LIMIT;
+	unsigned e = n / ( 1u << SUB_BITS ) + 6;
+	uint64_t sub = n % ( 1u << SUB_BITS );
+	double width = static_cast< double >( UINT64_C( 1 ) << ( e - SUB_BITS ) );
+	return ( ( 1u << SUB_BITS ) + sub ) * width + width / 2;
+}
+
+/* ---------------------------------------------------------------------------------
+   Find the mount points from /proc/self/mountinfo.  The fifth field is the mount
+   point, with spaces and such escaped in octal.
+   ------------------------------------------------------------------------------ */
+static void load_mounts( vector< string > & mounts )
+{
+	ifstream in( "/proc/self/mountinfo" );
+	string line;
+	while( getline( in, line ) )
+	{
+		istringstream fields( line );
+		string field;
+		for( int i = 0; i < 5; ++i )
+			fields >> field;
+
+		string mount;
+		for( size_t i = 0; i < field.size(); ++i )
+		{
+			if( '\\' == field[ i ] && i + 3 < field.size() )
+			{
+				mount += static_cast< char >( strtol( field.substr( i + 1, 3 ).c_str(), NULL, 8 ) );
+				i += 3;
+			}
+			else
+				mount += field[ i ];
+		}
+
+		if( ! mount.empty() )
+			mounts.push_back( mount );
+	}
+}
+
+// Return the mount point that a path lies under: the longest one that matches
+// the beginning of the path at a directory boundary.
+static string find_mount( const vector< string > & mounts, const string & dirname )
+{
+	string best( "/" );
+	for( size_t i = 0; i < mounts.size(); ++i )
+	{
+		const string & m = mounts[ i ];
+		if( m.size() > best.size() && 0 == dirname.compare( 0, m.size(), m ) &&
+			( dirname.size() == m.size() || '/' == dirname[ m.size() ] ) )
+			best = m;
+	}
+	return best;
+}
+
+// Return the first two components of a path, e.g. "/nix/store" for
+// "/nix/store/abc-foo/bin", or the whole path if it's shorter.
+static string find_prefix( const string & dirname )
+{
+	string::size_type pos = dirname.find( '/', 1 );
+	if( string::npos != pos )
+		pos = dirname.find( '/', pos + 1 );
+	return string::npos == pos ? dirname : dirname.substr( 0, pos );
+}
+
+/* ---------------------------------------------------------------------------------
+   Add the timings of one run to a table: each one counts toward the histogram for
+   its entry, for its prefix, and for its mount.
+   ------------------------------------------------------------------------------ */
+void tally_latency( const vector< CheckTiming > & timings, LatencyTable & table )
+{
+	if( timings.empty() )
+		return;
+
+	vector< string > mounts;
+	load_mounts( mounts );
+
+	for( size_t i = 0; i < timings.size(); ++i )
+	{
+		const CheckTiming & t = timings[ i ];
+		uint32_t b = bucket_of( t.ns );
+		++table[ "entry " + t.dirname ].buckets[ b ];
+		++table[ "prefix " + find_prefix( t.dirname ) ].buckets[ b ];
+		++table[ "mount " + find_mount( mounts, t.dirname ) ].buckets[ b ];
+	}
+}
+
+/* ---------------------------------------------------------------------------------
+   Parse the contents of a latency file into a table, adding to what's there.
+   Ignore lines that we can't make sense of.
+   ------------------------------------------------------------------------------ */
+static void parse_latency( istream & in, LatencyTable & table )
+{
+	string line;
+	while( getline( in, line ) )
+	{
+		string::size_type tab = line.find( '\t' );
+		if( string::npos == tab )
+			continue;
+
+		LatencyHist & hist = table[ line.substr( 0, tab ) ];
+		istringstream pairs( line.substr( tab + 1 ) );
+		string pair;
+		while( pairs >> pair )
+		{
+			char * colon = NULL;
+			unsigned long bucket = strtoul( pair.c_str(), &colon, 10 );
+			if( ':' != *colon )
+				continue;
+			uint64_t count = strtoul( colon + 1, NULL, 10 );
+			hist.buckets[ static_cast< uint32_t >( bucket ) ] += count;
+		}
+	}
+}
+
+void read_latency_file( const char * filename, LatencyTable & table )
+{
+	ifstream in( filename );
+	if( ! in )
+	{
+		string msg( "Unable to open latency file " );
+		msg += filename;
+		throw runtime_error( msg );
+	}
+
+	parse_latency( in, table );
+}
+
+/* ---------------------------------------------------------------------------------
+   Add the counts in a latency file (creating it if necessary) to a table, and
+   write the combined table back to the file.
+   ------------------------------------------------------------------------------ */
+void merge_latency_file( const char * filename, LatencyTable & table )
+{
+	int fd = open( filename, O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+	if( fd < 0 || flock( fd, LOCK_EX ) != 0 )
+	{
+		string msg( "Unable to open latency file " );
+		msg += filename;
+		msg += ": ";
+		msg += strerror( errno );
+		if( fd >= 0 )
+			close( fd );
+		throw runtime_error( msg );
+	}
+
+	string contents;
+	char buf[ 8192 ];
+	ssize_t n;
+	while( ( n = read( fd, buf, sizeof buf ) ) > 0 )
+		contents.append( buf, n );
+
+	istringstream in( contents );
+	parse_latency( in, table );
+
+	ostringstream out;
+	LatencyTable::const_iterator iter = table.begin();
+	for( ; iter != table.end(); ++iter )
+	{
+		out << iter->first << '\t';
+		map< uint32_t, uint64_t >::const_iterator b = iter->second.buckets.begin();
+		for( ; b != iter->second.buckets.end(); ++b )
+		{
+			if( b != iter->second.buckets.begin() )
+				out << ' ';
+			out << b->first << ':' << b->second;
+		}
+		out << '\n';
+	}
+
+	string text = out.str();
+	bool ok = 0 == ftruncate( fd, 0 ) &&
+		static_cast< ssize_t >( text.size() ) == pwrite( fd, text.data(), text.size(), 0 );
+	close( fd );   // Releases the lock
+	if( ! ok )
+	{
+		string msg( "Unable to write latency file " );
+		msg += filename;
+		throw runtime_error( msg );
+	}
+}
+
+// Summary of one histogram, for ranking:
+struct HistSummary
+{
+	const string * key;
+	uint64_t count;
+	double total_ns;
+	double p50_ns;
+	double p99_ns;
+	double max_ns;
+};
+
+static void summarize( const LatencyHist & hist, HistSummary & s )
+{
+	s.count = 0;
+	s.total_ns = 0;
+	map< uint32_t, uint64_t >::const_iterator iter = hist.buckets.begin();
+	for( ; iter != hist.buckets.end(); ++iter )
+	{
+		s.count += iter->second;
+		s.total_ns += iter->second * value_of( iter->first );
+	}
+
+	s.p50_ns = s.p99_ns = s.max_ns = 0;
+	uint64_t seen = 0;
+	for( iter = hist.buckets.begin(); iter != hist.buckets.end(); ++iter )
+	{
+		seen += iter->second;
+		double v = value_of( iter->first );
+		if( 0 == s.p50_ns && seen * 2 >= s.count )
+			s.p50_ns = v;
+		if( 0 == s.p99_ns && seen * 100 >= s.count * 99 )
+			s.p99_ns = v;
+		s.max_ns = v;
+	}
+}
+
+/* ---------------------------------------------------------------------------------
+   Write a report: for each kind of key, the top few, ranked by total time spent
+   in checks.
+   ------------------------------------------------------------------------------ */
+void report_latency( ostream & out, const LatencyTable & table, size_t top )
+{
+	static const char * const kinds[] = { "entry", "prefix", "mount" };
+
+	ios::fmtflags flags = out.flags();
+	out << fixed << setprecision( 1 );
+
+	for( size_t k = 0; k < sizeof kinds / sizeof kinds[ 0 ]; ++k )
+	{
+		string kind( kinds[ k ] );
+		multimap< double, HistSummary > ranked;
+		LatencyTable::const_iterator iter = table.begin();
+		for( ; iter != table.end(); ++iter )
+		{
+			if( 0 != iter->first.compare( 0, kind.size() + 1, kind + ' ' ) )
+				continue;
+
+			HistSummary s;
+			s.key = &iter->first;
+			summarize( iter->second, s );
+			ranked.insert( make_pair( -s.total_ns, s ) );
+		}
+
+		if( ranked.empty() )
+			continue;
+
+		out << setw( 8 ) << "checks" << setw( 12 ) << "total ms" << setw( 10 ) << "p50 us"
+			<< setw( 10 ) << "p99 us" << setw( 10 ) << "max us" << "  " << kind << '\n';
+
+		size_t shown = 0;
+		multimap< double, HistSummary >::const_iterator r = ranked.begin();
+		for( ; r != ranked.end() && shown < top; ++r, ++shown )
+		{
+			const HistSummary & s = r->second;
+			out << setw( 8 ) << s.count << setw( 12 ) << setprecision( 3 ) << s.total_ns / 1e6
+				<< setprecision( 1 ) << setw( 10 ) << s.p50_ns / 1e3 << setw( 10 ) << s.p99_ns / 1e3
+				<< setw( 10 ) << s.max_ns / 1e3 << "  " << s.key->substr( kind.size() + 1 ) << '\n';
+		}
+		out << '\n';
+	}
+
+	out.flags( flags );
+}
@@ -0,0 +1,57 @@
+/*
+    latency.h -- declarations for timing the directory checks: histograms of check
+    latency per entry, per path prefix and per mount, optionally accumulated in a
+    file across runs.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// The time taken by one directory check:
+struct CheckTiming
+{
+	std::string dirname;
+	uint64_t ns;
+};
+
+// A histogram of latencies in nanoseconds, in the style of HdrHistogram: linear
+// below 64 ns, and above that, 32 buckets for each power of two, so that every
+// bucket is within about 3% of the values in it.  Only non-empty buckets are
+// stored.
+struct LatencyHist
+{
+	std::map< uint32_t, uint64_t > buckets;   // Bucket number -> count
+};
+
+// Histograms by key, where a key is a kind ("entry", "prefix" or "mount"), a
+// space, and a directory:
+typedef std::map< std::string, LatencyHist > LatencyTable;
+
+void tally_latency( const std::vector< CheckTiming > & timings, LatencyTable & table );
+void merge_latency_file( const char * filename, LatencyTable & table );
+void read_latency_file( const char * filename, LatencyTable & table );
+void report_latency( std::ostream & out, const LatencyTable & table, size_t top );
+
+#endif
@@ -0,0 +1,226 @@
+/*
+    lookupcost.cpp -- estimate how many failed lookups execvp() makes per command when
+    searching a path list, and find an order of the list that makes fewer without
+    changing which binary any command name resolves to.
+
+    execvp() tries each directory of PATH in turn until execve() succeeds, so running a
+    command found in the k-th directory costs k - 1 failed lookups.  Given a histogram
+    of how often each command is run, the expected cost per exec is the weighted mean
+    of those failures.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#include "lookupcost.h"
+#include <cstdlib>
+#include <cstring>
+#include <set>
+
+namespace std {}
+using namespace std;
+
+/* ---------------------------------------------------------------------------------
+   Extract the command name from one line of a usage histogram, and its count.
+   Return false if the line names no command that execvp() would search for.
+   We accept several formats:
+
+   - "COUNT NAME", e.g. the output of "sort | uniq -c"
+   - audit EXECVE records, which name the program in a0="..."
+   - shell history: the first word of the line, after any zsh timestamp prefix
+   ------------------------------------------------------------------------------ */
+static bool parse_usage_line( const string & line, string & name, double & count )
+{
+	count = 1;
+
+	string::size_type pos = line.find( " a0=\"" );
+	if( string::npos != line.find( "type=EXECVE" ) && string::npos != pos )
+	{
+		pos += 5;
+		string::size_type end = line.find( '"', pos );
+		if( string::npos == end )
+			return false;
+		name.assign( line, pos, end - pos );
+
+		// The audit record has the name as given to execve(), which may be a
+		// full path; the base name is what the user's PATH search was for.
+
+		string::size_type slash = name.rfind( '/' );
+		if( string::npos != slash )
+			name.erase( 0, slash + 1 );
+		return ! name.empty();
+	}
+
+	const char * p = line.c_str();
+	if( ':' == p[ 0 ] && ' ' == p[ 1 ] )
+	{
+		const char * semi = strchr( p, ';' );   // zsh: ": 1700000000:0;command"
+		if( semi )
+			p = semi + 1;
+	}
+
+	p += strspn( p, " \t" );
+	char * end = NULL;
+	double n = strtod( p, &end );
+	if( end != p && ( ' ' == *end || '\t' == *end ) )
+	{
+		count = n;
+		p = end + strspn( end, " \t" );
+	}
+
+	size_t len = strcspn( p, " \t\r\n;|&<>()" );
+	name.assign( p, len );
+
+	// A name with a slash isn't searched for in PATH
+	return ! name.empty() && string::npos == name.find( '/' ) && count > 0;
+}
+
+/* ---------------------------------------------------------------------------------
+   Read a usage histogram, one command per line, and add each command's count to the
+   usage map.
+   ------------------------------------------------------------------------------ */
+void read_usage( istream & in, map< string, double > & usage )
+{
+	string line;
+	string name;
+	double count;
+
+	while( getline( in, line ) )
+	{
+		if( parse_usage_line( line, name, count ) )
+			usage[ name ] += count;
+	}
+}
+
+/* ---------------------------------------------------------------------------------
+   Compute the expected number of failed lookups per exec for the directories in the
+   given order.
+   ------------------------------------------------------------------------------ */
+static double expected_cost( const vector< double > & dir_uses, const vector< size_t > & order,
+	double uses )
+{
+	if( 0 == uses )
+		return 0;
+
+	double total = 0;
+	for( size_t pos = 0; pos < order.size(); ++pos )
+		total += dir_uses[ order[ pos ] ] * pos;
+
+	return total / uses;
+}
+
+/* ---------------------------------------------------------------------------------
+   Simulate execvp() over the directories, in the given order, for every command in
+   the usage histogram, and suggest a cheaper order.
+
+   A reordering must not change which binary wins, so wherever a name appears in
+   more than one directory, the directory that now provides it must stay ahead of
+   the others that have it.  A directory that we couldn't list may hold anything,
+   so it stays where it is relative to every other directory.
+
+   Finding the best order under such precedence constraints is hard in general, so
+   we build it greedily: at each step, of the directories whose predecessors have
+   all been placed, place the one that resolves the most executions, breaking ties
+   by the original order.  With no constraints this is optimal.
+   ------------------------------------------------------------------------------ */
+void simulate_lookups( const vector< CostDir > & dirs, const map< string, double > & usage,
+	LookupCost & result )
+{
+	size_t n = dirs.size();
+
+	// Find the winner for each name, and the precedence constraints
+
+	map< string, size_t > winner;
+	vector< set< size_t > > succs( n );
+	vector< size_t > pred_count( n, 0 );
+
+	for( size_t i = 0; i < n; ++i )
+	{
+		const vector< string > & names = dirs[ i ].names;
+		for( size_t j = 0; j < names.size(); ++j )
+		{
+			pair< map< string, size_t >::iterator, bool > ins =
+				winner.insert( make_pair( names[ j ], i ) );
+			if( ! ins.second && ins.first->second != i )
+				succs[ ins.first->second ].insert( i );
+		}
+
+		if( ! dirs[ i ].scanned )
+		{
+			for( size_t k = 0; k < n; ++k )
+			{
+				if( k < i )
+					succs[ k ].insert( i );
+				else if( k > i )
+					succs[ i ].insert( k );
+			}
+		}
+	}
+
+	for( size_t i = 0; i < n; ++i )
+	{
+		set< size_t >::const_iterator iter = succs[ i ].begin();
+		for( ; iter != succs[ i ].end(); ++iter )
+			++pred_count[ *iter ];
+	}
+
+	// Tally executions by the directory that resolves them
+
+	result.uses = 0;
+	result.unresolved_uses = 0;
+	result.dir_uses.assign( n, 0 );
+
+	map< string, double >::const_iterator use = usage.begin();
+	for( ; use != usage.end(); ++use )
+	{
+		map< string, size_t >::const_iterator win = winner.find( use->first );
+		if( win == winner.end() )
+			result.unresolved_uses += use->second;
+		else
+		{
+			result.dir_uses[ win->second ] += use->second;
+			result.uses += use->second;
+		}
+	}
+
+	// Place the directories greedily
+
+	result.order.clear();
+	vector< bool > placed( n, false );
+	while( result.order.size() < n )
+	{
+		size_t best = n;
+		for( size_t i = 0; i < n; ++i )
+		{
+			if( ! placed[ i ] && 0 == pred_count[ i ] &&
+				( n == best || result.dir_uses[ i ] > result.dir_uses[ best ] ) )
+				best = i;
+		}
+
+		placed[ best ] = true;
+		result.order.push_back( best );
+
+		set< size_t >::const_iterator iter = succs[ best ].begin();
+		for( ; iter != succs[ best ].end(); ++iter )
+			--pred_count[ *iter ];
+	}
+
+	vector< size_t > identity( n );
+	for( size_t i = 0; i < n; ++i )
+		identity[ i ] = i;
+
+	result.cost_before = expected_cost( result.dir_uses, identity, result.uses );
+	result.cost_after = expected_cost( result.dir_uses, result.order, result.uses );
+}
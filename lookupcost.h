@@ -0,0 +1,52 @@
+/*
+    lookupcost.h -- declarations for estimating what a path list costs execvp(), and
+    for finding a cheaper order for it.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#ifndef LOOKUPCOST_H
+#define LOOKUPCOST_H
+
+#include <stddef.h>
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+
+// What a directory in the path list contributes to the simulation:
+struct CostDir
+{
+	std::vector< std::string > names;   // Executables in the directory
+	bool scanned;                  // False if we couldn't list it, e.g. a relative path
+};
+
+// Results of simulate_lookups():
+struct LookupCost
+{
+	double uses;                   // Executions of commands found in the path list
+	double unresolved_uses;        // Executions of commands not found at all
+	double cost_before;            // Expected failed lookups per exec, in the given order
+	double cost_after;             // Expected failed lookups per exec, in the suggested order
+	std::vector< double > dir_uses;     // Executions resolved by each directory
+	std::vector< size_t > order;   // Suggested order, as indexes into the directories
+};
+
+void read_usage( std::istream & in, std::map< std::string, double > & usage );
+void simulate_lookups( const std::vector< CostDir > & dirs,
+	const std::map< std::string, double > & usage, LookupCost & result );
+
+#endif
@@ -0,0 +1,125 @@
+/*
+    makeplugin.cpp -- a plugin for GNU make that provides catpath as a native make
+    function, so that makefiles needn't run $(shell catpath ...) for every
+    evaluation.  Load it with
+
+        load ./catpath.so
+
+    and then
+
+        $(catpath LIST[,LIST...])
+
+    expands to the concatenation of the colon-separated path lists, following a
+    fixed subset of catpath's rules: each directory appears only once, in its
+    first position, and a fully qualified directory that doesn't exist is
+    dropped.  There are no options: no other separator, no tilde expansion, and
+    nothing like -d, -E, -f, -X or -r.  Each argument may hold several lists
+    separated by whitespace, so that $(catpath $(A) $(B)) works as expected.
+
+    The plugin keeps the result of every directory check for the life of the make
+    process, so that the expansions of one make check each directory only once;
+    a sub-make loads the plugin afresh, and checks again.
+    $(catpath-refresh LIST[,LIST...]) is the same as $(catpath ...), except that it
+    first discards those results, e.g. after a rule has installed the tools that
+    the lists refer to.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#include "pathlist.h"
+#include <cctype>
+#include <cstring>
+
+namespace std {}
+using namespace std;
+
+// gnumake.h has no extern "C" of its own:
+extern "C"
+{
+#include <gnumake.h>
+
+	int plugin_is_GPL_compatible;
+
+	int catpath_gmk_setup( const gmk_floc * floc );
+}
+
+static char * catpath_func( const char * name, unsigned int argc, char ** argv );
+static char * refresh_func( const char * name, unsigned int argc, char ** argv );
+
+// One path list, reused for every expansion, whose records remember the checks:
+static EditablePath * path_list = NULL;
+
+/* ---------------------------------------------------------------------------------
+   Called by make when it loads the plugin.
+   ------------------------------------------------------------------------------ */
+int catpath_gmk_setup( const gmk_floc * floc )
+{
+	( void ) floc;
+
+	if( NULL == path_list )
+		path_list = new EditablePath;
+
+	gmk_add_function( "catpath", catpath_func, 1, 0, GMK_FUNC_DEFAULT );
+	gmk_add_function( "catpath-refresh", refresh_func, 1, 0, GMK_FUNC_DEFAULT );
+	return 1;
+}
+
+/* ---------------------------------------------------------------------------------
+   Expand $(catpath ...).  Join the whitespace-separated words of all the arguments
+   into one list, and let the EditablePath apply the rules.
+   ------------------------------------------------------------------------------ */
+static char * catpath_func( const char * name, unsigned int argc, char ** argv )
+{
+	( void ) name;
+
+	string joined;
+	for( unsigned int i = 0; i < argc; ++i )
+	{
+		const char * p = argv[ i ];
+		for( ;; )
+		{
+			while( isspace( static_cast< unsigned char >( *p ) ) )
+				++p;
+			if( '\0' == *p )
+				break;
+
+			const char * start = p;
+			while( *p && ! isspace( static_cast< unsigned char >( *p ) ) )
+				++p;
+
+			if( ! joined.empty() )
+				joined += ':';
+			joined.append( start, p - start );
+		}
+	}
+
+	path_list->assign( joined.c_str() );
+	const string & result = path_list->str();
+	if( result.empty() )
+		return NULL;
+
+	char * buf = gmk_alloc( result.size() + 1 );
+	memcpy( buf, result.c_str(), result.size() + 1 );
+	return buf;
+}
+
+// Expand $(catpath-refresh ...): check every directory again.
+static char * refresh_func( const char * name, unsigned int argc, char ** argv )
+{
+	path_list->clear();
+	path_list->forget_checks();
+	return catpath_func( name, argc, argv );
+}
@@ -0,0 +1,488 @@
+/*
+    pathindex.cpp -- reading and writing the executable index.  See pathindex.h for
+    the layout of the file.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#include "pathindex.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace std {}
+using namespace std;
+
+static const uint32_t KEYS_PER_BUCKET = 4;     // Average bucket size for CHD
+static const unsigned MAX_SEEDS = 64;          // Give up after this many seeds
+static const uint64_t MAX_TRIES = 1 << 22;     // Displacements to try per bucket
+
+// Where a key lands, before displacement:
+struct KeySlot
+{
+	uint32_t bucket;
+	uint32_t f1;
+	uint32_t f2;
+};
+
+static void place_key( uint64_t h, uint32_t bucket_count, uint32_t key_count, KeySlot & ks );
+static bool build_disps( const vector< KeySlot > & key_slots, uint32_t bucket_count,
+	vector< IndexDisp > & disps, vector< uint32_t > & slot_of );
+static size_t align8( size_t n );
+
+/* ---------------------------------------------------------------------------------
+   Derive a key's bucket and its two hash values from the key's hash.
+   ------------------------------------------------------------------------------ */
+static void place_key( uint64_t h, uint32_t bucket_count, uint32_t key_count, KeySlot & ks )
+{
+	uint64_t g = h * UINT64_C( 0x9e3779b97f4a7c15 );
+	g ^= g >> 29;
+
+	ks.bucket = static_cast< uint32_t >( ( h >> 32 ) % bucket_count );
+	ks.f1 = static_cast< uint32_t >( ( g & 0xffffffff ) % key_count );
+	ks.f2 = static_cast< uint32_t >( ( g >> 32 ) % key_count );
+}
+
+/* ---------------------------------------------------------------------------------
+   Return the slot selected by a pair of displacements.
+   ------------------------------------------------------------------------------ */
+static inline uint32_t disp_slot( const KeySlot & ks, uint32_t d0, uint32_t d1, uint32_t m )
+{
+	return static_cast< uint32_t >(
+		( ks.f1 + static_cast< uint64_t >( d0 ) * ks.f2 % m + d1 ) % m );
+}
+
+// For sorting buckets by size, largest first:
+struct BucketOrder
+{
+	const vector< vector< uint32_t > > * members;
+	bool operator()( uint32_t a, uint32_t b ) const
+	{
+		return ( *members )[ a ].size() > ( *members )[ b ].size();
+	}
+};
+
+/* ---------------------------------------------------------------------------------
+   Find a pair of displacements for each bucket, so that every key lands in a
+   different slot.  Following CHD, we place the largest buckets first, while there
+   are still many free slots.  Buckets with a single key can simply be steered to
+   any free slot.  Return false if some bucket can't be placed, in which case the
+   caller should try again with a different seed.
+   ------------------------------------------------------------------------------ */
+static bool build_disps( const vector< KeySlot > & key_slots, uint32_t bucket_count,
+	vector< IndexDisp > & disps, vector< uint32_t > & slot_of )
+{
+	uint32_t m = static_cast< uint32_t >( key_slots.size() );
+
+	vector< vector< uint32_t > > members( bucket_count );
+	for( uint32_t i = 0; i < m; ++i )
+		members[ key_slots[ i ].bucket ].push_back( i );
+
+	vector< uint32_t > order( bucket_count );
+	for( uint32_t b = 0; b < bucket_count; ++b )
+		order[ b ] = b;
+	BucketOrder by_size;
+	by_size.members = &members;
+	stable_sort( order.begin(), order.end(), by_size );
+
+	disps.assign( bucket_count, IndexDisp() );
+	slot_of.assign( m, 0 );
+	vector< bool > taken( m, false );
+	uint32_t free_cursor = 0;
+
+	for( uint32_t oi = 0; oi < bucket_count; ++oi )
+	{
+		uint32_t b = order[ oi ];
+		const vector< uint32_t > & keys = members[ b ];
+		IndexDisp & disp = disps[ b ];
+		disp.d0 = 0;
+		disp.d1 = 0;
+
+		if( keys.empty() )
+			continue;
+
+		if( 1 == keys.size() )
+		{
+			while( taken[ free_cursor ] )
+				++free_cursor;
+
+			const KeySlot & ks = key_slots[ keys[ 0 ] ];
+			disp.d1 = ( free_cursor + m - ks.f1 ) % m;
+			taken[ free_cursor ] = true;
+			slot_of[ keys[ 0 ] ] = free_cursor;
+			continue;
+		}
+
+		bool placed = false;
+		uint64_t tries = 0;
+		for( uint32_t d0 = 0; d0 < m && ! placed && tries < MAX_TRIES; ++d0 )
+		{
+			for( uint32_t d1 = 0; d1 < m && tries < MAX_TRIES; ++d1, ++tries )
+			{
+				// Tentatively claim a slot for each key, backing out on a collision
+
+				size_t k = 0;
+				for( ; k < keys.size(); ++k )
+				{
+					uint32_t slot = disp_slot( key_slots[ keys[ k ] ], d0, d1, m );
+					if( taken[ slot ] )
+						break;
+					taken[ slot ] = true;
+					slot_of[ keys[ k ] ] = slot;
+				}
+
+				if( k == keys.size() )
+				{
+					disp.d0 = d0;
+					disp.d1 = d1;
+					placed = true;
+					break;
+				}
+
+				while( k > 0 )
+				{
+					--k;
+					taken[ slot_of[ keys[ k ] ] ] = false;
+				}
+			}
+		}
+
+		if( ! placed )
+			return false;
+	}
+
+	return true;
+}
+
+static size_t align8( size_t n )
+{
+	return ( n + 7 ) & ~static_cast< size_t >( 7 );
+}
+
+/* ---------------------------------------------------------------------------------
+   Write an index file describing a path list, its directories, and the commands
+   found in them.  Each entry names a command and the first directory that provides
+   it; names must be unique.  Write to a temporary file and rename it into place,
+   so that a process using the old index never sees a partial one.
+   ------------------------------------------------------------------------------ */
+void write_index( const char * filename, const string & path,
+	const vector< IndexDirInfo > & dirs, const vector< IndexEntry > & entries )
+{
+	if( dirs.size() > 0xffff )
+		throw runtime_error( string( "Too many directories to index" ) );
+
+	uint32_t key_count = static_cast< uint32_t >( entries.size() );
+	uint32_t bucket_count = ( key_count + KEYS_PER_BUCKET - 1 ) / KEYS_PER_BUCKET;
+	if( 0 == bucket_count )
+		bucket_count = 1;
+
+	// Search for a seed that yields a perfect hash function
+
+	vector< uint64_t > hashes( key_count );
+	vector< KeySlot > key_slots( key_count );
+	vector< IndexDisp > disps;
+	vector< uint32_t > slot_of;
+	uint64_t seed = 0;
+
+	bool found = false;
+	for( unsigned attempt = 0; attempt < MAX_SEEDS && ! found; ++attempt )
+	{
+		seed = index_hash( reinterpret_cast< const char * >( &attempt ), sizeof attempt,
+			UINT64_C( 0x5eed ) );
+		for( uint32_t i = 0; i < key_count; ++i )
+		{
+			const string & name = entries[ i ].name;
+			hashes[ i ] = index_hash( name.data(), name.size(), seed );
+			place_key( hashes[ i ], bucket_count, key_count, key_slots[ i ] );
+		}
+
+		found = build_disps( key_slots, bucket_count, disps, slot_of );
+	}
+
+	if( ! found )
+		throw runtime_error( string( "Unable to construct a perfect hash for the index" ) );
+
+	// Build the string pool and the fixed-width tables
+
+	string pool;
+	vector< IndexRecord > records( key_count );
+	for( uint32_t i = 0; i < key_count; ++i )
+	{
+		const IndexEntry & entry = entries[ i ];
+		if( entry.name.size() > 0xffff )
+			throw runtime_error( string( "Command name too long to index" ) );
+
+		IndexRecord & rec = records[ slot_of[ i ] ];
+		rec.name_offset = static_cast< uint32_t >( pool.size() );
+		rec.name_length = static_cast< uint16_t >( entry.name.size() );
+		rec.dir = static_cast< uint16_t >( entry.dir );
+		rec.hash = static_cast< uint32_t >( hashes[ i ] );
+		rec.reserved = 0;
+		pool += entry.name;
+	}
+
+	uint32_t flags = 0;
+	vector< IndexDir > dir_recs( dirs.size() );
+	for( size_t i = 0; i < dirs.size(); ++i )
+	{
+		const IndexDirInfo & info = dirs[ i ];
+		IndexDir & dir = dir_recs[ i ];
+		memset( &dir, 0, sizeof dir );
+		dir.path_offset = static_cast< uint32_t >( pool.size() );
+		dir.path_length = static_cast< uint32_t >( info.path.size() );
+		dir.mtime_sec = info.mtime_sec;
+		dir.mtime_nsec = info.mtime_nsec;
+		dir.dev = info.dev;
+		dir.ino = info.ino;
+		pool += info.path;
+
+		if( ! info.scanned )
+			flags |= INDEX_RELATIVE;
+	}
+
+	uint32_t path_offset = static_cast< uint32_t >( pool.size() );
+	pool += path;
+
+	// Lay out the file
+
+	IndexHeader header;
+	memset( &header, 0, sizeof header );
+	memcpy( header.magic, INDEX_MAGIC, sizeof header.magic );
+	header.version = INDEX_VERSION;
+	header.header_size = sizeof header;
+	header.flags = flags;
+	header.key_count = key_count;
+	header.bucket_count = bucket_count;
+	header.dir_count = static_cast< uint32_t >( dirs.size() );
+	header.seed = seed;
+	header.disp_offset = align8( sizeof header );
+	header.record_offset = align8( header.disp_offset + bucket_count * sizeof( IndexDisp ) );
+	header.dir_offset = align8( header.record_offset + key_count * sizeof( IndexRecord ) );
+	header.pool_offset = align8( header.dir_offset + dir_recs.size() * sizeof( IndexDir ) );
+	header.pool_size = pool.size();
+	header.path_offset = path_offset;
+	header.path_length = static_cast< uint32_t >( path.size() );
+	header.file_size = align8( header.pool_offset + pool.size() );
+
+	vector< unsigned char > buf( header.file_size, 0 );
+	if( ! disps.empty() )
+		memcpy( &buf[ header.disp_offset ], &disps[ 0 ], disps.size() * sizeof( IndexDisp ) );
+	if( ! records.empty() )
+		memcpy( &buf[ header.record_offset ], &records[ 0 ],
+			records.size() * sizeof( IndexRecord ) );
+	if( ! dir_recs.empty() )
+		memcpy( &buf[ header.dir_offset ], &dir_recs[ 0 ], dir_recs.size() * sizeof( IndexDir ) );
+	if( ! pool.empty() )
+		memcpy( &buf[ header.pool_offset ], pool.data(), pool.size() );
+
+	header.body_sum = index_checksum( &buf[ sizeof header ], buf.size() - sizeof header );
+	header.header_sum = index_checksum( &header, offsetof( IndexHeader, header_sum ) );
+	memcpy( &buf[ 0 ], &header, sizeof header );
+
+	// Write it out
+
+	char pid_buf[ 32 ];
+	sprintf( pid_buf, ".tmp.%ld", static_cast< long >( getpid() ) );
+	string tmp_name( filename );
+	tmp_name += pid_buf;
+
+	int fd = open( tmp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+	if( fd < 0 )
+	{
+		string msg( "Unable to create index file \"" );
+		msg += tmp_name;
+		msg += "\": ";
+		msg += strerror( errno );
+		throw runtime_error( msg );
+	}
+
+	size_t done = 0;
+	while( done < buf.size() )
+	{
+		ssize_t n = write( fd, &buf[ done ], buf.size() - done );
+		if( n < 0 && EINTR == errno )
+			continue;
+		if( n <= 0 )
+		{
+			string msg( "Unable to write index file \"" );
+			msg += tmp_name;
+			msg += "\": ";
+			msg += strerror( errno );
+			close( fd );
+			unlink( tmp_name.c_str() );
+			throw runtime_error( msg );
+		}
+		done += n;
+	}
+
+	if( close( fd ) != 0 || rename( tmp_name.c_str(), filename ) != 0 )
+	{
+		string msg( "Unable to install index file \"" );
+		msg += filename;
+		msg += "\": ";
+		msg += strerror( errno );
+		unlink( tmp_name.c_str() );
+		throw runtime_error( msg );
+	}
+}
+
+/* ---------------------------------------------------------------------------------
+   Map an index file into memory, and make sure that it is one we can use: that the
+   header is intact and describes sections that fit in the file.  If verify is true,
+   also verify the checksum of the rest of the file, which costs a pass over it.
+   Return false if the file can't be opened or isn't valid.
+
+   This function is also used by the exec preload library, so it doesn't throw.
+   ------------------------------------------------------------------------------ */
+bool open_index( const char * filename, PathIndex & index, bool verify )
+{
+	index.base = NULL;
+	index.size = 0;
+	index.header = NULL;
+
+	int fd = open( filename, O_RDONLY | O_CLOEXEC );
+	if( fd < 0 )
+		return false;
+
+	struct stat st;
+	if( fstat( fd, &st ) != 0 || st.st_size < static_cast< off_t >( sizeof( IndexHeader ) ) )
+	{
+		close( fd );
+		return false;
+	}
+
+	void * addr = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( MAP_FAILED == addr )
+		return false;
+
+	index.base = static_cast< const unsigned char * >( addr );
+	index.size = st.st_size;
+	index.header = static_cast< const IndexHeader * >( addr );
+
+	const IndexHeader & h = *index.header;
+	bool ok =
+		0 == memcmp( h.magic, INDEX_MAGIC, sizeof h.magic ) &&
+		INDEX_VERSION == h.version &&
+		sizeof( IndexHeader ) == h.header_size &&
+		h.header_sum == index_checksum( &h, offsetof( IndexHeader, header_sum ) ) &&
+		h.file_size == index.size &&
+		h.bucket_count > 0 &&
+		h.disp_offset + h.bucket_count * sizeof( IndexDisp ) <= h.record_offset &&
+		h.record_offset + h.key_count * sizeof( IndexRecord ) <= h.dir_offset &&
+		h.dir_offset + h.dir_count * sizeof( IndexDir ) <= h.pool_offset &&
+		h.pool_offset + h.pool_size <= h.file_size &&
+		static_cast< uint64_t >( h.path_offset ) + h.path_length <= h.pool_size;
+
+	if( ok && verify )
+		ok = h.body_sum == index_checksum( index.base + sizeof h, index.size - sizeof h );
+
+	if( ok )
+	{
+		// Directory paths are used without further checks, so check them now
+
+		for( uint32_t i = 0; i < h.dir_count && ok; ++i )
+		{
+			const IndexDir * dir = index_dir( index, i );
+			ok = static_cast< uint64_t >( dir->path_offset ) + dir->path_length <= h.pool_size;
+		}
+	}
+
+	if( ! ok )
+		close_index( index );
+
+	return ok;
+}
+
+void close_index( PathIndex & index )
+{
+	if( index.base )
+		munmap( const_cast< unsigned char * >( index.base ), index.size );
+
+	index.base = NULL;
+	index.size = 0;
+	index.header = NULL;
+}
+
+/* ---------------------------------------------------------------------------------
+   Look up a command name in an index.  Return a pointer to its record, or NULL if
+   the index doesn't list it.
+   ------------------------------------------------------------------------------ */
+const IndexRecord * lookup_index( const PathIndex & index, const char * name, size_t length )
+{
+	const IndexHeader & h = *index.header;
+	if( 0 == h.key_count )
+		return NULL;
+
+	uint64_t hash = index_hash( name, length, h.seed );
+	KeySlot ks;
+	place_key( hash, h.bucket_count, h.key_count, ks );
+
+	const IndexDisp & disp =
+		reinterpret_cast< const IndexDisp * >( index.base + h.disp_offset )[ ks.bucket ];
+	uint32_t slot = disp_slot( ks, disp.d0 % h.key_count, disp.d1 % h.key_count, h.key_count );
+
+	const IndexRecord & rec =
+		reinterpret_cast< const IndexRecord * >( index.base + h.record_offset )[ slot ];
+	if( rec.hash != static_cast< uint32_t >( hash ) || rec.name_length != length )
+		return NULL;
+	if( static_cast< uint64_t >( rec.name_offset ) + rec.name_length > h.pool_size ||
+		rec.dir >= h.dir_count )
+		return NULL;
+	if( memcmp( index_string( index, rec.name_offset ), name, length ) != 0 )
+		return NULL;
+
+	return &rec;
+}
+
+/* ---------------------------------------------------------------------------------
+   Compute a 64-bit checksum, a word at a time.  It's meant to catch corruption and
+   truncation, not tampering.
+   ------------------------------------------------------------------------------ */
+uint64_t index_checksum( const void * data, size_t length )
+{
+	const unsigned char * p = static_cast< const unsigned char * >( data );
+	uint64_t h = UINT64_C( 0x9e3779b97f4a7c15 ) ^ length;
+
+	while( length >= 8 )
+	{
+		uint64_t word;
+		memcpy( &word, p, 8 );
+		h ^= word;
+		h *= UINT64_C( 0xff51afd7ed558ccd );
+		h ^= h >> 32;
+		p += 8;
+		length -= 8;
+	}
+
+	while( length > 0 )
+	{
+		h ^= *p++;
+		h *= UINT64_C( 0x100000001b3 );
+		--length;
+	}
+
+	h ^= h >> 33;
+	h *= UINT64_C( 0xc4ceb9fe1a85ec53 );
+	h ^= h >> 33;
+	return h;
+}
@@ -0,0 +1,167 @@
+/*
+    pathindex.h -- declarations for the executable index: a file that maps command names
+    to the directories of a path list where they are found, in a form that can be used
+    directly from mmap().
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#ifndef PATHINDEX_H
+#define PATHINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+   Layout of an index file:
+
+       IndexHeader
+       IndexDisp[ bucket_count ]     displacements for the perfect hash function
+       IndexRecord[ key_count ]      one per command name, in hash order
+       IndexDir[ dir_count ]         one per directory in the path list
+       string pool                   names, directory paths and the path list
+
+   The hash function is a minimal perfect hash in the style of CHD ("compress, hash
+   and displace"): a key's bucket selects a pair of displacements, which in turn
+   select the key's one and only slot in the record table.  A lookup touches the
+   displacement table, one record, and the name in the string pool.
+
+   All integers are in native byte order, and all offsets are from the start of
+   the file, except that name and path offsets are from the start of the pool.
+*/
+
+static const char INDEX_MAGIC[ 8 ] = { 'C', 'A', 'T', 'P', 'I', 'D', 'X', '\0' };
+static const uint32_t INDEX_VERSION = 1;
+
+// Values for IndexHeader::flags:
+static const uint32_t INDEX_RELATIVE = 0x1;   // Path list has relative or unlisted entries
+
+struct IndexHeader
+{
+	char magic[ 8 ];               // INDEX_MAGIC
+	uint32_t version;              // INDEX_VERSION
+	uint32_t header_size;          // sizeof( IndexHeader )
+	uint32_t flags;                // INDEX_RELATIVE, etc.
+	uint32_t key_count;            // Number of records
+	uint32_t bucket_count;         // Number of displacement pairs
+	uint32_t dir_count;            // Number of directories
+	uint64_t seed;                 // Seed for index_hash()
+	uint64_t disp_offset;          // Location of displacement table
+	uint64_t record_offset;        // Location of record table
+	uint64_t dir_offset;           // Location of directory table
+	uint64_t pool_offset;          // Location of string pool
+	uint64_t pool_size;            // Size of string pool
+	uint32_t path_offset;          // Path list that the index was built from
+	uint32_t path_length;
+	uint64_t file_size;            // Size of the whole file
+	uint64_t body_sum;             // Checksum of everything after the header
+	uint64_t header_sum;           // Checksum of the header up to this member
+};
+
+struct IndexDisp
+{
+	uint32_t d0;
+	uint32_t d1;
+};
+
+struct IndexRecord
+{
+	uint32_t name_offset;          // Command name, in the pool
+	uint16_t name_length;
+	uint16_t dir;                  // Index into the directory table
+	uint32_t hash;                 // Low bits of the name's hash, for quick rejection
+	uint32_t reserved;
+};
+
+struct IndexDir
+{
+	uint32_t path_offset;          // Directory path, in the pool
+	uint32_t path_length;
+	int64_t mtime_sec;             // Modification time when the index was built
+	int64_t mtime_nsec;
+	uint64_t dev;                  // Device and inode, to detect replacement
+	uint64_t ino;
+};
+
+// What the writer needs to know about a directory:
+struct IndexDirInfo
+{
+	std::string path;
+	bool scanned;                  // False for relative paths and unlistable directories
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint64_t dev;
+	uint64_t ino;
+};
+
+// What the writer needs to know about a command:
+struct IndexEntry
+{
+	std::string name;
+	uint32_t dir;                  // Index of the first directory that provides it
+};
+
+// An index file mapped into memory:
+struct PathIndex
+{
+	const unsigned char * base;
+	size_t size;
+	const IndexHeader * header;
+};
+
+void write_index( const char * filename, const std::string & path,
+	const std::vector< IndexDirInfo > & dirs, const std::vector< IndexEntry > & entries );
+bool open_index( const char * filename, PathIndex & index, bool verify );
+void close_index( PathIndex & index );
+const IndexRecord * lookup_index( const PathIndex & index, const char * name, size_t length );
+uint64_t index_checksum( const void * data, size_t length );
+
+/* ---------------------------------------------------------------------------------
+   Hash a command name: FNV-1a, followed by a finalizer to spread the bits.
+   ------------------------------------------------------------------------------ */
+inline uint64_t index_hash( const char * name, size_t length, uint64_t seed )
+{
+	uint64_t h = seed ^ UINT64_C( 0xcbf29ce484222325 );
+	for( size_t i = 0; i < length; ++i )
+	{
+		h ^= static_cast< unsigned char >( name[ i ] );
+		h *= UINT64_C( 0x100000001b3 );
+	}
+
+	h ^= h >> 33;
+	h *= UINT64_C( 0xff51afd7ed558ccd );
+	h ^= h >> 33;
+	h *= UINT64_C( 0xc4ceb9fe1a85ec53 );
+	h ^= h >> 33;
+	return h;
+}
+
+// Accessors for the sections of a mapped index:
+
+inline const IndexDir * index_dir( const PathIndex & index, uint32_t i )
+{
+	return reinterpret_cast< const IndexDir * >(
+		index.base + index.header->dir_offset ) + i;
+}
+
+inline const char * index_string( const PathIndex & index, uint32_t offset )
+{
+	return reinterpret_cast< const char * >( index.base + index.header->pool_offset + offset );
+}
+
+#endif
@@ -0,0 +1,311 @@
+/*
+    pathlist.cpp -- an editable path list, with a persistent hash index and cached
+    directory checks.
+
+    The entries form a doubly linked list threaded through a vector of records, and
+    an open-addressing hash table maps each directory to its record.  Records are
+    never deleted, only unlinked, which keeps the hash table free of tombstones and
+    lets a directory that comes back skip its check.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#include "pathlist.h"
+#include <cstring>
+#include <sys/stat.h>
+
+namespace std {}
+using namespace std;
+
+static uint64_t hash_dirname( const string & dirname )
+{
+	uint64_t h = UINT64_C( 0xcbf29ce484222325 );
+	for( size_t i = 0; i < dirname.size(); ++i )
+	{
+		h ^= static_cast< unsigned char >( dirname[ i ] );
+		h *= UINT64_C( 0x100000001b3 );
+	}
+	return h ^ ( h >> 29 );
+}
+
+EditablePath::EditablePath( char sep, bool force ) :
+	sep_( sep ), force_( force ), slots_( 64, NIL ), head_( NIL ), tail_( NIL ),
+	visible_( 0 ), text_valid_( false )
+{}
+
+/* ---------------------------------------------------------------------------------
+   Replace the contents with a separated list of directories, keeping the first
+   occurrence of each and ignoring empty entries, as catpath does.
+   ------------------------------------------------------------------------------ */
+void EditablePath::assign( const char * path_list )
+{
+	clear();
+	if( NULL == path_list )
+		return;
+
+	const char * start = path_list;
+	for( ;; )
+	{
+		const char * stop = strchr( start, sep_ );
+		size_t len = stop ? static_cast< size_t >( stop - start ) : strlen( start );
+		if( len > 0 )
+		{
+			string dirname( start, len );
+			if( ! contains( dirname ) )
+				append( dirname );
+		}
+
+		if( NULL == stop )
+			break;
+		start = stop + 1;
+	}
+}
+
+/* ---------------------------------------------------------------------------------
+   Put a directory at the front of the list, moving it if it's already there.
+   Return true if it passed the check, i.e. if it appears in str().  An empty name,
+   which the joined text would show as the current directory, is ignored, as
+   catpath ignores empty entries; so is a name holding the separator.
+   ------------------------------------------------------------------------------ */
+bool EditablePath::prepend( const string & dirname )
+{
+	if( ! valid_name( dirname ) )
+		return false;
+
+	int32_t r = intern( dirname );
+	unlink( r );
+
+	Record & rec = records_[ r ];
+	rec.in_list = true;
+	rec.prev = NIL;
+	rec.next = head_;
+	if( NIL != head_ )
+		records_[ head_ ].prev = r;
+	else
+		tail_ = r;
+	head_ = r;
+
+	bool ok = check( rec );
+	if( ok )
+		++visible_;
+	text_valid_ = false;
+	return ok;
+}
+
+/* ---------------------------------------------------------------------------------
+   Put a directory at the end of the list, moving it if it's already there.
+   Return true if it passed the check.  Ignore an empty name or one holding the
+   separator, as prepend() does.
+   ------------------------------------------------------------------------------ */
+bool EditablePath::append( const string & dirname )
+{
+	if( ! valid_name( dirname ) )
+		return false;
+
+	int32_t r = intern( dirname );
+	unlink( r );
+
+	Record & rec = records_[ r ];
+	rec.in_list = true;
+	rec.next = NIL;
+	rec.prev = tail_;
+	if( NIL != tail_ )
+		records_[ tail_ ].next = r;
+	else
+		head_ = r;
+	tail_ = r;
+
+	bool ok = check( rec );
+	if( ok )
+		++visible_;
+	text_valid_ = false;
+	return ok;
+}
+
+// Return true if a name can be an entry of the list.
+bool EditablePath::valid_name( const string & dirname ) const
+{
+	return ! dirname.empty() && string::npos == dirname.find( sep_ );
+}
+
+/* ---------------------------------------------------------------------------------
+   Take a directory out of the list.  Return false if it wasn't there.
+   ------------------------------------------------------------------------------ */
+bool EditablePath::remove( const string & dirname )
+{
+	int32_t r = find( dirname, hash_dirname( dirname ) );
+	if( NIL == r || ! records_[ r ].in_list )
+		return false;
+
+	unlink( r );
+	text_valid_ = false;
+	return true;
+}
+
+bool EditablePath::contains( const string & dirname ) const
+{
+	int32_t r = find( dirname, hash_dirname( dirname ) );
+	return NIL != r && records_[ r ].in_list;
+}
+
+void EditablePath::clear()
+{
+	for( int32_t r = head_; NIL != r; r = records_[ r ].next )
+		records_[ r ].in_list = false;
+
+	head_ = tail_ = NIL;
+	visible_ = 0;
+	text_valid_ = false;
+}
+
+/* ---------------------------------------------------------------------------------
+   Discard the cached check results, e.g. after software has been installed, and
+   check every directory in the list again.
+   ------------------------------------------------------------------------------ */
+void EditablePath::forget_checks()
+{
+	for( size_t i = 0; i < records_.size(); ++i )
+		records_[ i ].verdict = -1;
+
+	visible_ = 0;
+	for( int32_t r = head_; NIL != r; r = records_[ r ].next )
+	{
+		if( check( records_[ r ] ) )
+			++visible_;
+	}
+	text_valid_ = false;
+}
+
+// Number of directories that appear in str():
+size_t EditablePath::size() const
+{
+	return visible_;
+}
+
+const string & EditablePath::str() const
+{
+	if( ! text_valid_ )
+	{
+		text_.clear();
+		for( int32_t r = head_; NIL != r; r = records_[ r ].next )
+		{
+			if( ! records_[ r ].verdict )
+				continue;
+			if( ! text_.empty() )
+				text_ += sep_;
+			text_ += records_[ r ].dirname;
+		}
+		text_valid_ = true;
+	}
+
+	return text_;
+}
+
+int32_t EditablePath::find( const string & dirname, uint64_t hash ) const
+{
+	size_t mask = slots_.size() - 1;
+	for( size_t i = hash & mask; ; i = ( i + 1 ) & mask )
+	{
+		int32_t r = slots_[ i ];
+		if( NIL == r )
+			return NIL;
+		if( records_[ r ].hash == hash && records_[ r ].dirname == dirname )
+			return r;
+	}
+}
+
+/* ---------------------------------------------------------------------------------
+   Return the record for a directory, creating one (not in the list, not yet
+   checked) if there isn't one.
+   ------------------------------------------------------------------------------ */
+int32_t EditablePath::intern( const string & dirname )
+{
+	uint64_t hash = hash_dirname( dirname );
+	int32_t r = find( dirname, hash );
+	if( NIL != r )
+		return r;
+
+	if( 2 * ( records_.size() + 1 ) > slots_.size() )
+		grow();
+
+	Record rec;
+	rec.dirname = dirname;
+	rec.hash = hash;
+	rec.prev = rec.next = NIL;
+	rec.in_list = false;
+	rec.verdict = -1;
+	r = static_cast< int32_t >( records_.size() );
+	records_.push_back( rec );
+
+	size_t mask = slots_.size() - 1;
+	size_t i = hash & mask;
+	while( NIL != slots_[ i ] )
+		i = ( i + 1 ) & mask;
+	slots_[ i ] = r;
+	return r;
+}
+
+/* ---------------------------------------------------------------------------------
+   Apply catpath's existence check to a directory, unless we already know the
+   answer: a fully qualified path must be a directory, unless force is true.
+   ------------------------------------------------------------------------------ */
+bool EditablePath::check( Record & rec )
+{
+	if( rec.verdict < 0 )
+	{
+		struct stat stat_buf;
+		rec.verdict = force_ || '/' != rec.dirname.c_str()[ 0 ] ||
+			( 0 == stat( rec.dirname.c_str(), &stat_buf ) && S_ISDIR( stat_buf.st_mode ) );
+	}
+
+	return rec.verdict;
+}
+
+// Take a record out of the list, if it's in it.
+void EditablePath::unlink( int32_t r )
+{
+	Record & rec = records_[ r ];
+	if( ! rec.in_list )
+		return;
+
+	if( NIL != rec.prev )
+		records_[ rec.prev ].next = rec.next;
+	else
+		head_ = rec.next;
+	if( NIL != rec.next )
+		records_[ rec.next ].prev = rec.prev;
+	else
+		tail_ = rec.prev;
+
+	rec.prev = rec.next = NIL;
+	rec.in_list = false;
+	if( rec.verdict > 0 )
+		--visible_;
+}
+
+// Double the hash table, and reinsert every record.
+void EditablePath::grow()
+{
+	slots_.assign( slots_.size() * 2, NIL );
+	size_t mask = slots_.size() - 1;
+	for( size_t r = 0; r < records_.size(); ++r )
+	{
+		size_t i = records_[ r ].hash & mask;
+		while( NIL != slots_[ i ] )
+			i = ( i + 1 ) & mask;
+		slots_[ i ] = static_cast< int32_t >( r );
+	}
+}
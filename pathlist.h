@@ -0,0 +1,91 @@
+/*
+    pathlist.h -- declarations for an editable path list: the library form of catpath,
+    for programs such as module systems that modify one path list many times.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#ifndef PATHLIST_H
+#define PATHLIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/* ---------------------------------------------------------------------------------
+   A path list that follows catpath's rules -- no duplicates, and no fully
+   qualified directories that don't exist -- and that can be edited one entry at a
+   time.  It keeps a hash index of its entries and the result of each directory
+   check between operations, so that prepend(), append() and remove() cost O(1)
+   amortized time plus at most one check, and str() rebuilds the text only after
+   something has changed.
+
+   Adding a directory that's already in the list moves it, as module systems
+   expect.  A directory that fails the check keeps its place in the list, but
+   doesn't appear in the text; the check is not repeated unless forget_checks()
+   is called.
+   ------------------------------------------------------------------------------ */
+class EditablePath
+{
+public:
+	explicit EditablePath( char sep = ':', bool force = false );
+
+	void assign( const char * path_list );
+	bool prepend( const std::string & dirname );
+	bool append( const std::string & dirname );
+	bool remove( const std::string & dirname );
+	bool contains( const std::string & dirname ) const;
+	void clear();
+	void forget_checks();
+
+	size_t size() const;
+	const std::string & str() const;
+
+private:
+	enum { NIL = -1 };
+
+	// One per distinct directory seen, whether or not it's still in the list,
+	// so that the check result survives removal and re-addition:
+	struct Record
+	{
+		std::string dirname;
+		uint64_t hash;
+		int32_t prev;              // Neighbors in the list, or NIL
+		int32_t next;
+		bool in_list;
+		signed char verdict;       // 1 if it passed the check, 0 if not, -1 unknown
+	};
+
+	bool valid_name( const std::string & dirname ) const;
+	int32_t find( const std::string & dirname, uint64_t hash ) const;
+	int32_t intern( const std::string & dirname );
+	bool check( Record & rec );
+	void unlink( int32_t r );
+	void grow();
+
+	char sep_;
+	bool force_;
+	std::vector< Record > records_;
+	std::vector< int32_t > slots_; // Record index for each hash slot, or NIL
+	int32_t head_;
+	int32_t tail_;
+	size_t visible_;               // Entries in the list that passed the check
+	mutable std::string text_;     // Cached result of str()
+	mutable bool text_valid_;
+};
+
+#endif
@@ -0,0 +1,350 @@
+/*
+    pathview.h -- lazy views over path lists, for C++ programs that want catpath's
+    rules without running catpath.  Header only.
+
+    A view yields one directory at a time, as a PathEntry, and does no work until
+    asked for the next one.  Views compose with operator|, mirroring the steps of
+    parse_path() and build_path():
+
+        using namespace pathview;
+        string path = join( split( getenv( "PATH" ) ) | expand() | unique() | existing() );
+
+    split() tokenizes the text in place; expand() replaces a leading "~/" with
+    $HOME, as -x does; unique() drops every occurrence of a directory after the
+    first; existing() drops a fully qualified directory unless it is a directory
+    that can be reached, as catpath does without -f.  Put unique() before
+    existing() to avoid checking a directory twice -- the result is the same either
+    way.  A consumer that stops early, such as first(), leaves the rest of the list
+    untouched, so no directory after the one it returns is ever checked.
+
+    Views are single-pass, like input iterators, and hold their source by value.
+    An entry stays valid only until the view advances, unless it comes from split()
+    (it points into the original text) or unique() (it points into the view's own
+    set of names); use PathEntry::to_string() to keep one.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#ifndef PATHVIEW_H
+#define PATHVIEW_H
+
+#include "smallbuf.h"
+#include <cstdlib>
+#include <iterator>
+#include <set>
+#include <sys/stat.h>
+
+namespace pathview
+{
+
+/* ---------------------------------------------------------------------------------
+   An input iterator over a view, so that views work with the standard algorithms.
+   Advancing the iterator advances the view.
+   ------------------------------------------------------------------------------ */
+template< typename View >
+class ViewIterator
+{
+public:
+	typedef std::input_iterator_tag iterator_category;
+	typedef PathEntry value_type;
+	typedef ptrdiff_t difference_type;
+	typedef const PathEntry * pointer;
+	typedef const PathEntry & reference;
+
+	ViewIterator() : view_( NULL ) {}
+	explicit ViewIterator( View & view ) : view_( &view ) { advance(); }
+
+	const PathEntry & operator*() const { return curr_; }
+	const PathEntry * operator->() const { return &curr_; }
+	ViewIterator & operator++() { advance(); return *this; }
+	void operator++( int ) { advance(); }
+
+	bool operator==( const ViewIterator & other ) const { return view_ == other.view_; }
+	bool operator!=( const ViewIterator & other ) const { return view_ != other.view_; }
+
+private:
+	void advance()
+	{
+		if( view_ && ! view_->next( curr_ ) )
+			view_ = NULL;
+	}
+
+	View * view_;          // NULL at the end
+	PathEntry curr_;
+};
+
+/* ---------------------------------------------------------------------------------
+   Base for the views: supplies begin() and end() in terms of the derived class's
+   bool next( PathEntry & ), which returns false when there are no more entries.
+   ------------------------------------------------------------------------------ */
+template< typename Derived >
+class View
+{
+public:
+	typedef ViewIterator< Derived > iterator;
+
+	iterator begin() { return iterator( static_cast< Derived & >( *this ) ); }
+	iterator end() { return iterator(); }
+};
+
+/* ---------------------------------------------------------------------------------
+   The entries of a separated list, without copying them.  Empty entries are
+   skipped, as parse_path() does.  The separator may be more than one character.
+   ------------------------------------------------------------------------------ */
+class SplitView : public View< SplitView >
+{
+public:
+	SplitView( const char * text, const char * sep ) :
+		p_( text ), end_( text ? text + strlen( text ) : NULL ),
+		sep_( sep ), sep_len_( strlen( sep ) )
+	{}
+
+	bool next( PathEntry & out )
+	{
+		while( p_ )
+		{
+			const char * stop = find_sep();
+			out.str = p_;
+			out.len = ( stop ? stop : end_ ) - p_;
+			p_ = stop ? stop + sep_len_ : NULL;
+			if( out.len > 0 )
+				return true;
+		}
+		return false;
+	}
+
+private:
+	const char * find_sep() const
+	{
+		if( 0 == sep_len_ )
+			return NULL;
+
+		for( const char * p = p_; end_ - p >= static_cast< ptrdiff_t >( sep_len_ ); ++p )
+		{
+			if( 0 == memcmp( p, sep_, sep_len_ ) )
+				return p;
+		}
+		return NULL;
+	}
+
+	const char * p_;       // Start of the next entry, or NULL when done
+	const char * end_;
+	const char * sep_;
+	size_t sep_len_;
+};
+
+inline SplitView split( const char * text, const char * sep = ":" )
+{
+	return SplitView( text, sep );
+}
+
+/* ---------------------------------------------------------------------------------
+   Replace a leading "~/" with the home directory.  $HOME is read when the first
+   such entry comes along; if it isn't set, the entry is passed through unchanged.
+   ------------------------------------------------------------------------------ */
+template< typename Source >
+class ExpandView : public View< ExpandView< Source > >
+{
+public:
+	explicit ExpandView( const Source & source ) : source_( source ), home_( NULL ) {}
+
+	bool next( PathEntry & out )
+	{
+		if( ! source_.next( out ) )
+			return false;
+
+		if( out.len >= 2 && '~' == out.str[ 0 ] && '/' == out.str[ 1 ] )
+		{
+			if( NULL == home_ )
+			{
+				home_ = getenv( "HOME" );
+				if( NULL == home_ )
+					home_ = "";
+			}
+
+			if( *home_ )
+			{
+				buf_.assign( home_ );
+				buf_.append( out.str + 1, out.len - 1 );
+				out.str = buf_.data();
+				out.len = buf_.size();
+			}
+		}
+		return true;
+	}
+
+private:
+	Source source_;
+	const char * home_;    // NULL until needed; empty if $HOME isn't set
+	std::string buf_;      // The current expanded entry
+};
+
+struct ExpandTag {};
+
+inline ExpandTag expand()
+{
+	return ExpandTag();
+}
+
+template< typename Source >
+ExpandView< Source > operator|( const Source & source, ExpandTag )
+{
+	return ExpandView< Source >( source );
+}
+
+/* ---------------------------------------------------------------------------------
+   Drop the second and later occurrences of each directory.
+   ------------------------------------------------------------------------------ */
+template< typename Source >
+class UniqueView : public View< UniqueView< Source > >
+{
+public:
+	explicit UniqueView( const Source & source ) : source_( source ) {}
+
+	bool next( PathEntry & out )
+	{
+		while( source_.next( out ) )
+		{
+			std::pair< std::set< std::string >::iterator, bool > result =
+				seen_.insert( out.to_string() );
+			if( result.second )
+			{
+				out.str = result.first->data();
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	Source source_;
+	std::set< std::string > seen_;
+};
+
+struct UniqueTag {};
+
+inline UniqueTag unique()
+{
+	return UniqueTag();
+}
+
+template< typename Source >
+UniqueView< Source > operator|( const Source & source, UniqueTag )
+{
+	return UniqueView< Source >( source );
+}
+
+/* ---------------------------------------------------------------------------------
+   Drop a fully qualified directory that isn't a reachable directory, unless force
+   is true (as with -f).  Relative entries always pass, as they do in catpath.
+   Each entry is checked when it is reached, and not before.
+   ------------------------------------------------------------------------------ */
+template< typename Source >
+class ExistingView : public View< ExistingView< Source > >
+{
+public:
+	ExistingView( const Source & source, bool force ) : source_( source ), force_( force ) {}
+
+	bool next( PathEntry & out )
+	{
+		while( source_.next( out ) )
+		{
+			if( force_ || '/' != out.str[ 0 ] || is_dir( out ) )
+				return true;
+		}
+		return false;
+	}
+
+private:
+	static bool is_dir( const PathEntry & entry )
+	{
+		std::string dirname( entry.str, entry.len );
+		struct stat buf;
+		return 0 == stat( dirname.c_str(), &buf ) && S_ISDIR( buf.st_mode );
+	}
+
+	Source source_;
+	bool force_;
+};
+
+struct ExistingTag
+{
+	bool force;
+};
+
+inline ExistingTag existing( bool force = false )
+{
+	ExistingTag tag;
+	tag.force = force;
+	return tag;
+}
+
+template< typename Source >
+ExistingView< Source > operator|( const Source & source, ExistingTag tag )
+{
+	return ExistingView< Source >( source, tag.force );
+}
+
+/* ---------------------------------------------------------------------------------
+   Consumers.  join() materializes a view as a separated list, as join_path() does.
+   first() and find_first() stop at the first entry that qualifies, and return
+   false if there isn't one.  The view is taken by value, so that a temporary
+   chain can be passed directly.
+   ------------------------------------------------------------------------------ */
+template< typename Source >
+std::string join( Source source, const char * sep = ":" )
+{
+	std::string result;
+	PathEntry entry;
+	while( source.next( entry ) )
+	{
+		if( ! result.empty() )
+			result += sep;
+		result.append( entry.str, entry.len );
+	}
+	return result;
+}
+
+template< typename Source >
+bool first( Source source, std::string & out )
+{
+	PathEntry entry;
+	if( ! source.next( entry ) )
+		return false;
+
+	out.assign( entry.str, entry.len );
+	return true;
+}
+
+// Pred is called as pred( const PathEntry & ) and returns true for a match.
+template< typename Source, typename Pred >
+bool find_first( Source source, Pred pred, std::string & out )
+{
+	PathEntry entry;
+	while( source.next( entry ) )
+	{
+		if( pred( entry ) )
+		{
+			out.assign( entry.str, entry.len );
+			return true;
+		}
+	}
+	return false;
+}
+
+}  // namespace pathview
+
+#endif
@@ -0,0 +1,326 @@
+/*
+    perfcount.cpp -- count cycles, instructions, branch misses and cache misses for
+    each phase of a run, using perf_event_open().
+
+    The counters form a single group, so that they are scheduled onto the hardware
+    together and one read() collects them all.  At each phase boundary we read the
+    group and charge the difference to the phase that just ended.  Where a hardware
+    event is unavailable -- no PMU, as in many virtual machines, or access restricted
+    by perf_event_paranoid -- we substitute a software event where there's a useful
+    one (task-clock for cycles, page faults for cache misses) and otherwise leave the
+    column out.
+
+    Only the calling thread is counted, and only in user mode, which is what an
+    unprivileged process is normally allowed to see.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#include "perfcount.h"
+#include <stdint.h>
+#include <cstring>
+#include <iomanip>
+#include <string>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace std {}
+using namespace std;
+
+namespace
+{
+
+// An event we'd like to count, and what to count instead if we can't:
+struct EventSpec
+{
+	const char * name;
+	uint32_t type;
+	uint64_t config;
+	const char * alt_name;         // NULL if there's no useful substitute
+	uint32_t alt_type;
+	uint64_t alt_config;
+	bool per_entry;                // Report per path list entry, not just a total
+};
+
+enum { EV_CYCLES, EV_INSTRUCTIONS, EV_BRANCH_MISSES, EV_CACHE_MISSES, EV_COUNT };
+
+const EventSpec specs[ EV_COUNT ] =
+{
+	{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,
+		"task-clock-ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, false },
+	{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,
+		NULL, 0, 0, false },
+	{ "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,
+		NULL, 0, 0, true },
+	{ "cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,
+		"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, true }
+};
+
+const char * const phase_names[ PHASE_COUNT ] =
+{
+	"parse_path",
+	"expand_path",
+	"filter_path",
+	"join_path",
+	"extras",
+	"output"
+};
+
+// An event that we managed to open:
+struct Counter
+{
+	int fd;
+	const char * name;
+	bool hardware;
+	bool per_entry;
+	int spec;                      // Which of specs[] it stands for
+};
+
+bool started = false;
+int leader_fd = -1;
+Counter counters[ EV_COUNT ];
+int counter_count = 0;
+
+int current_phase = -1;
+uint64_t last_values[ EV_COUNT ];
+uint64_t last_ns;
+
+uint64_t phase_values[ PHASE_COUNT ][ EV_COUNT ];
+uint64_t phase_ns[ PHASE_COUNT ];
+bool phase_seen[ PHASE_COUNT ];
+
+int perf_event_open( struct perf_event_attr * attr, int group_fd )
+{
+	return static_cast< int >( syscall( SYS_perf_event_open, attr, 0, -1, group_fd, 0UL ) );
+}
+
+int open_event( uint32_t type, uint64_t config )
+{
+	struct perf_event_attr attr;
+	memset( &attr, 0, sizeof attr );
+	attr.size = sizeof attr;
+	attr.type = type;
+	attr.config = config;
+	attr.read_format = PERF_FORMAT_GROUP;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	if( leader_fd < 0 )
+		attr.disabled = 1;   // The whole group starts when the leader does
+
+	return perf_event_open( &attr, leader_fd );
+}
+
+uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return static_cast< uint64_t >( ts.tv_sec ) * UINT64_C( 1000000000 ) + ts.tv_nsec;
+}
+
+/* ---------------------------------------------------------------------------------
+   Read the current value of every counter in the group into values[], indexed
+   as in counters[].  Return false if the read fails.
+   ------------------------------------------------------------------------------ */
+bool read_group( uint64_t * values )
+{
+	uint64_t buf[ 1 + EV_COUNT ];
+	ssize_t len = read( leader_fd, buf, sizeof buf );
+	if( len < static_cast< ssize_t >( sizeof( uint64_t ) * ( 1 + counter_count ) ) )
+		return false;
+
+	for( int i = 0; i < counter_count; ++i )
+		values[ i ] = buf[ 1 + i ];
+	return true;
+}
+
+/* ---------------------------------------------------------------------------------
+   Charge everything since the last boundary to the current phase.
+   ------------------------------------------------------------------------------ */
+void close_phase()
+{
+	uint64_t values[ EV_COUNT ];
+	uint64_t ns = now_ns();
+	if( ! read_group( values ) )
+		memcpy( values, last_values, sizeof values );
+
+	if( current_phase >= 0 )
+	{
+		for( int i = 0; i < counter_count; ++i )
+			phase_values[ current_phase ][ i ] += values[ i ] - last_values[ i ];
+		phase_ns[ current_phase ] += ns - last_ns;
+		phase_seen[ current_phase ] = true;
+	}
+
+	memcpy( last_values, values, sizeof last_values );
+	last_ns = ns;
+}
+
+int find_counter( int spec, bool hardware )
+{
+	for( int i = 0; i < counter_count; ++i )
+	{
+		if( counters[ i ].spec == spec && counters[ i ].hardware == hardware )
+			return i;
+	}
+	return -1;
+}
+
+}  // namespace
+
+/* ---------------------------------------------------------------------------------
+   Open the counters and start them.  Return false if we couldn't open any event
+   at all, hardware or software.
+   ------------------------------------------------------------------------------ */
+bool perf_start()
+{
+	for( int i = 0; i < EV_COUNT; ++i )
+	{
+		const EventSpec & spec = specs[ i ];
+		Counter & c = counters[ counter_count ];
+
+		c.fd = open_event( spec.type, spec.config );
+		c.name = spec.name;
+		c.hardware = true;
+		if( c.fd < 0 && spec.alt_name )
+		{
+			c.fd = open_event( spec.alt_type, spec.alt_config );
+			c.name = spec.alt_name;
+			c.hardware = false;
+		}
+
+		if( c.fd < 0 )
+			continue;
+
+		c.per_entry = spec.per_entry;
+		c.spec = i;
+		if( leader_fd < 0 )
+			leader_fd = c.fd;
+		++counter_count;
+	}
+
+	if( leader_fd < 0 )
+		return false;
+
+	ioctl( leader_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP );
+	ioctl( leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+	started = true;
+	close_phase();
+	return true;
+}
+
+/* ---------------------------------------------------------------------------------
+   Mark the start of a phase, ending the previous one.  Does nothing unless the
+   counters have been started, so the calls can stay in place in ordinary runs.
+   ------------------------------------------------------------------------------ */
+void perf_phase( PerfPhase phase )
+{
+	if( ! started )
+		return;
+
+	close_phase();
+	current_phase = phase;
+}
+
+void perf_stop()
+{
+	if( ! started )
+		return;
+
+	close_phase();
+	current_phase = -1;
+	ioctl( leader_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP );
+	for( int i = 0; i < counter_count; ++i )
+		close( counters[ i ].fd );
+	leader_fd = -1;
+	started = false;
+}
+
+/* ---------------------------------------------------------------------------------
+   Write a table with a row for each phase that ran: elapsed time, the count for
+   each event, instructions per cycle if we have both, and misses per entry.
+   ------------------------------------------------------------------------------ */
+void perf_report( ostream & out, size_t entries )
+{
+	if( 0 == counter_count )
+		return;
+
+	int cycles = find_counter( EV_CYCLES, true );
+	int instructions = find_counter( EV_INSTRUCTIONS, true );
+	bool ipc = cycles >= 0 && instructions >= 0;
+
+	out << "performance counters for " << entries << " entries";
+	for( int i = 0; i < EV_COUNT; ++i )
+	{
+		if( find_counter( i, true ) < 0 )
+		{
+			out << "; " << specs[ i ].name;
+			if( find_counter( i, false ) >= 0 )
+				out << " unavailable, using " << specs[ i ].alt_name;
+			else
+				out << " unavailable";
+		}
+	}
+	out << '\n';
+
+	out << left << setw( 12 ) << "phase" << right << setw( 10 ) << "usec";
+	for( int i = 0; i < counter_count; ++i )
+		out << setw( 15 ) << counters[ i ].name;
+	if( ipc )
+		out << setw( 7 ) << "IPC";
+	for( int i = 0; i < counter_count; ++i )
+	{
+		if( counters[ i ].per_entry )
+			out << setw( 22 ) << string( counters[ i ].name ) + "/entry";
+	}
+	out << '\n';
+
+	ios::fmtflags flags = out.flags();
+	for( int p = 0; p < PHASE_COUNT; ++p )
+	{
+		if( ! phase_seen[ p ] )
+			continue;
+
+		out << left << setw( 12 ) << phase_names[ p ] << right
+			<< fixed << setprecision( 1 ) << setw( 10 ) << phase_ns[ p ] / 1000.0;
+		for( int i = 0; i < counter_count; ++i )
+			out << setw( 15 ) << phase_values[ p ][ i ];
+
+		if( ipc )
+		{
+			if( phase_values[ p ][ cycles ] )
+				out << setw( 7 ) << setprecision( 2 ) << static_cast< double >(
+					phase_values[ p ][ instructions ] ) / phase_values[ p ][ cycles ];
+			else
+				out << setw( 7 ) << "-";
+		}
+
+		for( int i = 0; i < counter_count; ++i )
+		{
+			if( ! counters[ i ].per_entry )
+				continue;
+			if( entries )
+				out << setw( 22 ) << setprecision( 3 )
+					<< static_cast< double >( phase_values[ p ][ i ] ) / entries;
+			else
+				out << setw( 22 ) << "-";
+		}
+		out << '\n';
+	}
+	out.flags( flags );
+}
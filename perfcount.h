@@ -0,0 +1,43 @@
+/*
+    perfcount.h -- declarations for profiling the phases of a run with the kernel's
+    performance counters.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H
+
+#include <stddef.h>
+#include <ostream>
+
+enum PerfPhase
+{
+	PHASE_PARSE,                   // Splitting the arguments into entries
+	PHASE_EXPAND,                  // Tilde expansion and duplicate removal
+	PHASE_FILTER,                  // Checking the directories
+	PHASE_JOIN,                    // Reassembling the path list
+	PHASE_EXTRAS,                  // Pruning, indexing, analysis
+	PHASE_OUTPUT,                  // Writing the results
+	PHASE_COUNT
+};
+
+bool perf_start();
+void perf_phase( PerfPhase phase );
+void perf_stop();
+void perf_report( std::ostream & out, size_t entries );
+
+#endif
@@ -0,0 +1,144 @@
+/*
+    pyprune.cpp -- find the names that a directory on a Python module search path makes
+    importable, so that directories that supply nothing can be dropped from the path.
+
+    Python looks for every top-level import in every directory of sys.path, in order,
+    until it finds the name.  Each directory that can't supply the name costs at least
+    one failed stat(), so a directory that supplies nothing slows down every import
+    that has to get past it.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#include "pyprune.h"
+#include <cstring>
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace std {}
+using namespace std;
+
+/* ---------------------------------------------------------------------------------
+   Return true if the first len characters of name form a Python identifier.  We
+   accept any non-ASCII byte, since Python accepts many non-ASCII identifiers and
+   we'd rather keep a directory than drop one that Python would use.
+   ------------------------------------------------------------------------------ */
+static bool is_identifier( const char * name, size_t len )
+{
+	if( 0 == len || ( name[ 0 ] >= '0' && name[ 0 ] <= '9' ) )
+		return false;
+
+	for( size_t i = 0; i < len; ++i )
+	{
+		unsigned char c = name[ i ];
+		if( ! ( ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) ||
+			( c >= '0' && c <= '9' ) || '_' == c || c >= 0x80 ) )
+			return false;
+	}
+
+	return true;
+}
+
+/* ---------------------------------------------------------------------------------
+   Return true if name ends with suffix.
+   ------------------------------------------------------------------------------ */
+static bool ends_with( const char * name, size_t len, const char * suffix )
+{
+	size_t suffix_len = strlen( suffix );
+	return len >= suffix_len && 0 == memcmp( name + len - suffix_len, suffix, suffix_len );
+}
+
+/* ---------------------------------------------------------------------------------
+   Load into names the top-level names that an open directory makes importable,
+   sorted, and close the directory.  These are:
+
+   - packages: subdirectories whose names are identifiers.  We count namespace
+     packages (without __init__.py) too, since Python merges their portions from
+     every directory on the path.  __pycache__ holds compiled modules for the
+     directory itself, and supplies nothing to import.
+   - modules: "name.py" and "name.pyc"
+   - extension modules: "name.so", including tagged ones like "name.abi3.so"
+   - .pth files, listed under their full names.  Python only processes them in
+     site directories, but a directory that has them was put there for a reason.
+   ------------------------------------------------------------------------------ */
+void scan_python_dir( int dir_fd, vector< string > & names )
+{
+	names.clear();
+
+	DIR * dir = fdopendir( dir_fd );
+	if( NULL == dir )
+	{
+		close( dir_fd );
+		return;
+	}
+
+	struct dirent * ent;
+	while( ( ent = readdir( dir ) ) != NULL )
+	{
+		const char * name = ent->d_name;
+		size_t len = strlen( name );
+
+		if( ends_with( name, len, ".pth" ) )
+		{
+			names.push_back( string( name, len ) );
+			continue;
+		}
+
+		bool is_directory = DT_DIR == ent->d_type;
+		if( DT_UNKNOWN == ent->d_type || DT_LNK == ent->d_type )
+		{
+			struct stat buf;
+			is_directory = 0 == fstatat( dir_fd, name, &buf, 0 ) && S_ISDIR( buf.st_mode );
+		}
+
+		size_t stem;
+		if( is_directory )
+		{
+			if( 0 == strcmp( name, "__pycache__" ) )
+				continue;
+			stem = len;   // The whole name is the package name
+		}
+		else if( ends_with( name, len, ".py" ) )
+			stem = len - 3;
+		else if( ends_with( name, len, ".pyc" ) )
+			stem = len - 4;
+		else if( ends_with( name, len, ".so" ) )
+			stem = strchr( name, '.' ) - name;   // Drop any ABI tag too
+		else
+			continue;
+
+		if( is_identifier( name, stem ) )
+			names.push_back( string( name, stem ) );
+	}
+
+	closedir( dir );
+
+	sort( names.begin(), names.end() );
+	names.erase( unique( names.begin(), names.end() ), names.end() );
+}
+
+/* ---------------------------------------------------------------------------------
+   Return true if a path list entry names a zip archive that zipimport can load
+   modules from.  Such an entry is a file, not a directory, so it can't be scanned.
+   ------------------------------------------------------------------------------ */
+bool is_python_archive( const string & entry )
+{
+	return ends_with( entry.data(), entry.size(), ".zip" ) ||
+		ends_with( entry.data(), entry.size(), ".egg" );
+}
@@ -0,0 +1,30 @@
+/*
+    pyprune.h -- declarations for finding the names that a directory on a Python module
+    search path, such as PYTHONPATH, makes importable.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#ifndef PYPRUNE_H
+#define PYPRUNE_H
+
+#include <string>
+#include <vector>
+
+void scan_python_dir( int dir_fd, std::vector< std::string > & names );
+bool is_python_archive( const std::string & entry );
+
+#endif
@@ -0,0 +1,147 @@
+/*
+    radixtree.cpp -- a compressed radix tree of path list entries.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#include "radixtree.h"
+
+namespace std {}
+using namespace std;
+
+// The root is created by the first call to find_node(), so that a tree that's
+// never used, as in a run without -T or -X, costs no allocation.
+RadixTree::RadixTree()
+{}
+
+void RadixTree::exclude( const PathEntry & prefix )
+{
+	// Trailing slashes don't change what's under a directory; but "/" by
+	// itself excludes every fully qualified path.
+
+	size_t len = prefix.len;
+	while( len > 1 && '/' == prefix.str[ len - 1 ] )
+		--len;
+
+	bool excluded;
+	nodes_[ find_node( prefix.str, len, false, excluded ) ].excluded = true;
+}
+
+RadixTree::Result RadixTree::insert( const PathEntry & entry )
+{
+	bool excluded = false;
+	uint32_t n = find_node( entry.str, entry.len, true, excluded );
+	if( excluded )
+		return EXCLUDED;
+	if( nodes_[ n ].present )
+		return DUPLICATE;
+
+	nodes_[ n ].present = true;
+	return INSERTED;
+}
+
+/* ---------------------------------------------------------------------------------
+   Find the node where a key ends, creating it and splitting edges as necessary.
+   If exclude_check is true, watch along the way for an excluded prefix that ends
+   at a directory boundary of the key; if we find one, set excluded and return 0
+   without changing the tree any further.
+   ------------------------------------------------------------------------------ */
+uint32_t RadixTree::find_node( const char * key, size_t len, bool exclude_check,
+	bool & excluded )
+{
+	if( nodes_.empty() )
+	{
+		nodes_.reserve( 64 );
+		new_node( "", 0 );
+	}
+
+	uint32_t n = 0;
+	size_t pos = 0;
+
+	for( ;; )
+	{
+		if( exclude_check && nodes_[ n ].excluded &&
+			( pos == len || '/' == key[ pos ] || ( pos > 0 && '/' == key[ pos - 1 ] ) ) )
+		{
+			excluded = true;
+			return 0;
+		}
+
+		if( pos == len )
+			return n;
+
+		// Look for the child whose label starts with the next byte
+
+		uint32_t prev = 0;
+		uint32_t c = nodes_[ n ].child;
+		while( c && nodes_[ c ].label[ 0 ] != key[ pos ] )
+		{
+			prev = c;
+			c = nodes_[ c ].sibling;
+		}
+
+		if( 0 == c )
+		{
+			// Nothing shares this prefix; add a leaf for the rest of the key
+
+			uint32_t leaf = new_node( key + pos, len - pos );
+			nodes_[ leaf ].sibling = nodes_[ n ].child;
+			nodes_[ n ].child = leaf;
+			return leaf;
+		}
+
+		size_t common = 1;
+		size_t limit = len - pos;
+		if( limit > nodes_[ c ].label_len )
+			limit = nodes_[ c ].label_len;
+		while( common < limit && nodes_[ c ].label[ common ] == key[ pos + common ] )
+			++common;
+
+		if( common < nodes_[ c ].label_len )
+		{
+			// The key leaves the edge partway along; split the edge so that
+			// there is a node where they part company.
+
+			uint32_t mid = new_node( nodes_[ c ].label, common );
+			nodes_[ mid ].child = c;
+			nodes_[ mid ].sibling = nodes_[ c ].sibling;
+			nodes_[ c ].sibling = 0;
+			nodes_[ c ].label += common;
+			nodes_[ c ].label_len -= common;
+			if( prev )
+				nodes_[ prev ].sibling = mid;
+			else
+				nodes_[ n ].child = mid;
+			c = mid;
+		}
+
+		n = c;
+		pos += common;
+	}
+}
+
+uint32_t RadixTree::new_node( const char * label, size_t len )
+{
+	Node node;
+	node.label = label;
+	node.label_len = static_cast< uint32_t >( len );
+	node.child = 0;
+	node.sibling = 0;
+	node.present = false;
+	node.excluded = false;
+	nodes_.push_back( node );
+	return static_cast< uint32_t >( nodes_.size() - 1 );
+}
@@ -0,0 +1,76 @@
+/*
+    radixtree.h -- declarations for a compressed radix tree of path list entries, for
+    removing duplicates and excluding everything under given prefixes.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#ifndef RADIXTREE_H
+#define RADIXTREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "smallbuf.h"
+
+/* ---------------------------------------------------------------------------------
+   Each edge of the tree is labeled with a substring of some entry that was added
+   to it, and the nodes store references to those strings rather than copies, so
+   the strings must outlive the tree.  Entries that share a long prefix, such as
+   thousands of /nix/store/<hash>-<name>/bin directories, share the nodes for it.
+
+   A node has at most one child per distinct first byte of its children's labels,
+   so finding a child is a short scan of a sibling list.
+   ------------------------------------------------------------------------------ */
+class RadixTree
+{
+public:
+	enum Result
+	{
+		INSERTED,                  // New entry, now in the tree
+		DUPLICATE,                 // Already in the tree
+		EXCLUDED                   // Lies under an excluded prefix
+	};
+
+	RadixTree();
+
+	// Exclude a prefix: an entry is excluded if it is the prefix itself or
+	// lies in a directory under it.  Exclude all prefixes before inserting.
+	void exclude( const PathEntry & prefix );
+
+	// Add an entry, unless it's excluded.
+	Result insert( const PathEntry & entry );
+
+	size_t node_count() const { return nodes_.size(); }
+
+private:
+	struct Node
+	{
+		const char * label;        // Edge label, in somebody else's string
+		uint32_t label_len;
+		uint32_t child;            // First child, or 0 for none
+		uint32_t sibling;          // Next sibling, or 0 for none
+		bool present;              // An entry ends here
+		bool excluded;             // An excluded prefix ends here
+	};
+
+	uint32_t find_node( const char * key, size_t len, bool exclude_check, bool & excluded );
+	uint32_t new_node( const char * label, size_t len );
+
+	std::vector< Node > nodes_;    // nodes_[ 0 ] is the root
+};
+
+#endif
@@ -0,0 +1,473 @@
+/*
+    slowfs.cpp -- a library for LD_PRELOAD that makes chosen parts of the filesystem
+    slow, broken or hung, so that catpath's behavior with NFS and autofs trouble can
+    be measured without real servers.
+
+    It intercepts stat(), lstat(), fstatat(), statx(), access(), faccessat(),
+    open(), openat(), getdents64(), and the openat2, statx and getdents64 system
+    calls made through syscall().  Calls made inside the C library (e.g. readdir()
+    and fopen()) don't pass through these symbols, and aren't affected.
+
+    The file named by $SLOWFS_CONFIG has one rule per line:
+
+        PREFIX  ACTION  [OPS]
+
+    where ACTION is one of
+
+        delay MS        sleep MS milliseconds, then carry on
+        delay MIN-MAX   sleep a random time in that range
+        error NAME      fail with errno NAME (ENOENT, EACCES, EIO, ESTALE, ...)
+        hang            never return, like a hard mount of a dead server
+
+    and OPS, if present, limits the rule to some of the operations: a comma
+    separated list of "stat", "open" and "getdents".  A rule applies to a path if
+    PREFIX is the path or one of its parent directories; the longest such prefix
+    wins.  A '#' starts a comment that runs to the end of the line.  A line that
+    isn't a valid rule, e.g. one naming an unknown operation, is reported on
+    standard error and ignored.
+
+    Paths relative to a directory descriptor are resolved with /proc/self/fd, so
+    rules always match absolute paths.  Set $SLOWFS_SEED for a repeatable
+    sequence of random delays.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#include <cerrno>
+#include <climits>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+
+enum Op { OP_STAT = 1, OP_OPEN = 2, OP_GETDENTS = 4, OP_ALL = 7 };
+enum Action { ACT_DELAY, ACT_ERROR, ACT_HANG };
+
+struct Rule
+{
+	char prefix[ PATH_MAX ];
+	size_t prefix_len;
+	Action action;
+	long min_ms;                   // For ACT_DELAY
+	long max_ms;
+	int error;                     // For ACT_ERROR
+	int ops;                       // Bitmask of Op
+};
+
+const size_t MAX_RULES = 64;
+Rule rules[ MAX_RULES ];
+size_t rule_count = 0;
+
+pthread_once_t init_once = PTHREAD_ONCE_INIT;
+unsigned random_state = 1;
+pthread_mutex_t random_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The real functions:
+
+int ( *real_stat )( const char *, struct stat * );
+int ( *real_lstat )( const char *, struct stat * );
+int ( *real_fstatat )( int, const char *, struct stat *, int );
+int ( *real_statx )( int, const char *, int, unsigned, struct statx * );
+int ( *real_access )( const char *, int );
+int ( *real_faccessat )( int, const char *, int, int );
+int ( *real_open )( const char *, int, ... );
+int ( *real_openat )( int, const char *, int, ... );
+ssize_t ( *real_getdents64 )( int, void *, size_t );
+long ( *real_syscall )( long, ... );
+
+// Look up the next definition of a symbol.  ISO C++ doesn't allow a cast from
+// an object pointer to a function pointer, so copy the bits instead.
+template< typename Fn >
+void next_symbol( Fn & fn, const char * name )
+{
+	void * sym = dlsym( RTLD_NEXT, name );
+	memcpy( &fn, &sym, sizeof fn );
+}
+
+const struct { const char * name; int value; } error_names[] =
+{
+	{ "ENOENT", ENOENT }, { "EACCES", EACCES }, { "EIO", EIO }, { "ESTALE", ESTALE },
+	{ "ETIMEDOUT", ETIMEDOUT }, { "EHOSTDOWN", EHOSTDOWN }, { "ENOTDIR", ENOTDIR },
+	{ "ELOOP", ELOOP }, { "EPERM", EPERM }, { "ENOMEM", ENOMEM }, { "EINTR", EINTR }
+};
+
+/* ---------------------------------------------------------------------------------
+   Parse one line of the configuration file, with any comment already cut off,
+   into a rule.  Return false if it isn't one, including a rule that names an
+   unknown operation, which would otherwise never fire.
+   ------------------------------------------------------------------------------ */
+bool parse_rule( char * line, Rule & rule )
+{
+	const char * delims = " \t";
+	char * save = NULL;
+	char * prefix = strtok_r( line, delims, &save );
+	char * action = strtok_r( NULL, delims, &save );
+	if( NULL == prefix || NULL == action )
+		return false;
+
+	rule.prefix_len = strlen( prefix );
+	while( rule.prefix_len > 1 && '/' == prefix[ rule.prefix_len - 1 ] )
+		--rule.prefix_len;
+	if( rule.prefix_len >= sizeof rule.prefix )
+		return false;
+	memcpy( rule.prefix, prefix, rule.prefix_len );
+	rule.prefix[ rule.prefix_len ] = '\0';
+
+	char * arg = NULL;
+	if( 0 == strcmp( action, "delay" ) )
+	{
+		arg = strtok_r( NULL, delims, &save );
+		if( NULL == arg )
+			return false;
+		rule.action = ACT_DELAY;
+		char * end = NULL;
+		rule.min_ms = rule.max_ms = strtol( arg, &end, 10 );
+		if( '-' == *end )
+			rule.max_ms = strtol( end + 1, NULL, 10 );
+		if( rule.max_ms < rule.min_ms )
+			rule.max_ms = rule.min_ms;
+	}
+	else if( 0 == strcmp( action, "error" ) )
+	{
+		arg = strtok_r( NULL, delims, &save );
+		if( NULL == arg )
+			return false;
+		rule.action = ACT_ERROR;
+		rule.error = 0;
+		for( size_t i = 0; i < sizeof error_names / sizeof error_names[ 0 ]; ++i )
+		{
+			if( 0 == strcmp( arg, error_names[ i ].name ) )
+				rule.error = error_names[ i ].value;
+		}
+		if( 0 == rule.error )
+			rule.error = atoi( arg );
+		if( rule.error <= 0 )
+			return false;
+	}
+	else if( 0 == strcmp( action, "hang" ) )
+		rule.action = ACT_HANG;
+	else
+		return false;
+
+	rule.ops = OP_ALL;
+	char * ops = strtok_r( NULL, delims, &save );
+	if( ops )
+	{
+		rule.ops = 0;
+		char * save_op = NULL;
+		for( char * op = strtok_r( ops, ",", &save_op ); op; op = strtok_r( NULL, ",", &save_op ) )
+		{
+			if( 0 == strcmp( op, "stat" ) )
+				rule.ops |= OP_STAT;
+			else if( 0 == strcmp( op, "open" ) )
+				rule.ops |= OP_OPEN;
+			else if( 0 == strcmp( op, "getdents" ) )
+				rule.ops |= OP_GETDENTS;
+			else
+				return false;
+		}
+	}
+
+	return rule.ops != 0;
+}
+
+/* ---------------------------------------------------------------------------------
+   Find the real functions, and load the rules.  Read the configuration file with
+   the real open(), so that we don't intercept ourselves.
+   ------------------------------------------------------------------------------ */
+void init()
+{
+	next_symbol( real_stat, "stat" );
+	next_symbol( real_lstat, "lstat" );
+	next_symbol( real_fstatat, "fstatat" );
+	next_symbol( real_statx, "statx" );
+	next_symbol( real_access, "access" );
+	next_symbol( real_faccessat, "faccessat" );
+	next_symbol( real_open, "open" );
+	next_symbol( real_openat, "openat" );
+	next_symbol( real_getdents64, "getdents64" );
+	next_symbol( real_syscall, "syscall" );
+
+	const char * seed = getenv( "SLOWFS_SEED" );
+	random_state = seed ? static_cast< unsigned >( atoi( seed ) ) : static_cast< unsigned >( getpid() );
+
+	const char * config = getenv( "SLOWFS_CONFIG" );
+	if( NULL == config )
+		return;
+	int fd = real_open( config, O_RDONLY | O_CLOEXEC );
+	if( fd < 0 )
+		return;
+
+	static char text[ 65536 ];
+	ssize_t len = 0;
+	ssize_t n;
+	while( len < static_cast< ssize_t >( sizeof text - 1 ) &&
+		( n = read( fd, text + len, sizeof text - 1 - len ) ) > 0 )
+		len += n;
+	close( fd );
+	text[ len ] = '\0';
+
+	// Cut each line at the first '#'.  Complain about any line that's left with
+	// something in it but isn't a rule, since we can't refuse to run.
+
+	char * save = NULL;
+	for( char * line = strtok_r( text, "\n", &save ); line && rule_count < MAX_RULES;
+		line = strtok_r( NULL, "\n", &save ) )
+	{
+		char * hash = strchr( line, '#' );
+		if( hash )
+			*hash = '\0';
+		if( '\0' == line[ strspn( line, " \t" ) ] )
+			continue;
+
+		char msg[ 512 ];
+		int len = snprintf( msg, sizeof msg, "slowfs: ignoring bad rule: %s\n", line );
+		if( parse_rule( line, rules[ rule_count ] ) )
+			++rule_count;
+		else if( len > 0 )
+		{
+			if( len >= static_cast< int >( sizeof msg ) )
+				len = sizeof msg - 1;
+			ssize_t rc = write( STDERR_FILENO, msg, len );
+			(void) rc;
+		}
+	}
+}
+
+inline void ensure_init()
+{
+	pthread_once( &init_once, init );
+}
+
+// Find the rule with the longest prefix that covers a path, for an operation.
+const Rule * find_rule( const char * path, int op )
+{
+	const Rule * best = NULL;
+	for( size_t i = 0; i < rule_count; ++i )
+	{
+		const Rule & r = rules[ i ];
+		if( ! ( r.ops & op ) || 0 != strncmp( path, r.prefix, r.prefix_len ) )
+			continue;
+		char next = path[ r.prefix_len ];
+		if( ( '\0' == next || '/' == next || 1 == r.prefix_len ) &&
+			( NULL == best || r.prefix_len > best->prefix_len ) )
+			best = &r;
+	}
+	return best;
+}
+
+/* ---------------------------------------------------------------------------------
+   Make an absolute path out of a directory descriptor and a path relative to it.
+   If name is NULL, just find the descriptor's path.
+   ------------------------------------------------------------------------------ */
+bool resolve( int dirfd, const char * name, char * out, size_t size )
+{
+	if( name && '/' == *name )
+	{
+		strncpy( out, name, size - 1 );
+		out[ size - 1 ] = '\0';
+		return true;
+	}
+
+	size_t len;
+	if( AT_FDCWD == dirfd )
+	{
+		if( NULL == getcwd( out, size ) )
+			return false;
+		len = strlen( out );
+	}
+	else
+	{
+		char link[ 64 ];
+		snprintf( link, sizeof link, "/proc/self/fd/%d", dirfd );
+		ssize_t n = readlink( link, out, size - 1 );
+		if( n < 0 )
+			return false;
+		len = static_cast< size_t >( n );
+		out[ len ] = '\0';
+	}
+
+	if( name && *name && len + 1 + strlen( name ) < size )
+	{
+		if( len > 1 )
+			out[ len++ ] = '/';
+		strcpy( out + len, name );
+	}
+	return true;
+}
+
+/* ---------------------------------------------------------------------------------
+   Apply whatever rule covers a path.  Return 0 to go ahead with the real call, or
+   an errno value with which to fail it.
+   ------------------------------------------------------------------------------ */
+int apply( int dirfd, const char * name, int op )
+{
+	ensure_init();
+	if( 0 == rule_count )
+		return 0;
+
+	char path[ PATH_MAX ];
+	if( ! resolve( dirfd, name, path, sizeof path ) )
+		return 0;
+
+	const Rule * rule = find_rule( path, op );
+	if( NULL == rule )
+		return 0;
+
+	switch( rule->action )
+	{
+		case ACT_DELAY :
+		{
+			long ms = rule->min_ms;
+			if( rule->max_ms > rule->min_ms )
+			{
+				pthread_mutex_lock( &random_lock );
+				ms += rand_r( &random_state ) % ( rule->max_ms - rule->min_ms + 1 );
+				pthread_mutex_unlock( &random_lock );
+			}
+			struct timespec ts;
+			ts.tv_sec = ms / 1000;
+			ts.tv_nsec = ( ms % 1000 ) * 1000000;
+			while( nanosleep( &ts, &ts ) != 0 && EINTR == errno )
+				continue;
+			return 0;
+		}
+		case ACT_ERROR :
+			return rule->error;
+		case ACT_HANG :
+			for( ;; )
+				pause();
+	}
+
+	return 0;
+}
+
+}  // namespace
+
+/* ---- The intercepted functions ---- */
+
+#define SLOWFS_CHECK( dirfd, name, op ) \
+	do { int err_ = apply( dirfd, name, op ); if( err_ ) { errno = err_; return -1; } } while( 0 )
+
+extern "C"
+{
+
+int stat( const char * path, struct stat * buf )
+{
+	SLOWFS_CHECK( AT_FDCWD, path, OP_STAT );
+	return real_stat( path, buf );
+}
+
+int lstat( const char * path, struct stat * buf )
+{
+	SLOWFS_CHECK( AT_FDCWD, path, OP_STAT );
+	return real_lstat( path, buf );
+}
+
+int fstatat( int dirfd, const char * path, struct stat * buf, int flags )
+{
+	SLOWFS_CHECK( dirfd, path, OP_STAT );
+	return real_fstatat( dirfd, path, buf, flags );
+}
+
+int statx( int dirfd, const char * path, int flags, unsigned mask, struct statx * buf )
+{
+	SLOWFS_CHECK( dirfd, path, OP_STAT );
+	return real_statx( dirfd, path, flags, mask, buf );
+}
+
+int access( const char * path, int mode )
+{
+	SLOWFS_CHECK( AT_FDCWD, path, OP_STAT );
+	return real_access( path, mode );
+}
+
+int faccessat( int dirfd, const char * path, int mode, int flags )
+{
+	SLOWFS_CHECK( dirfd, path, OP_STAT );
+	return real_faccessat( dirfd, path, mode, flags );
+}
+
+int open( const char * path, int flags, ... )
+{
+	va_list ap;
+	va_start( ap, flags );
+	mode_t mode = va_arg( ap, mode_t );
+	va_end( ap );
+
+	SLOWFS_CHECK( AT_FDCWD, path, OP_OPEN );
+	return real_open( path, flags, mode );
+}
+
+int openat( int dirfd, const char * path, int flags, ... )
+{
+	va_list ap;
+	va_start( ap, flags );
+	mode_t mode = va_arg( ap, mode_t );
+	va_end( ap );
+
+	SLOWFS_CHECK( dirfd, path, OP_OPEN );
+	return real_openat( dirfd, path, flags, mode );
+}
+
+ssize_t getdents64( int fd, void * buf, size_t size )
+{
+	SLOWFS_CHECK( fd, NULL, OP_GETDENTS );
+	return real_getdents64( fd, buf, size );
+}
+
+long syscall( long number, ... )
+{
+	va_list ap;
+	va_start( ap, number );
+	long a[ 6 ];
+	for( int i = 0; i < 6; ++i )
+		a[ i ] = va_arg( ap, long );
+	va_end( ap );
+
+	switch( number )
+	{
+		case SYS_openat2 :
+			SLOWFS_CHECK( static_cast< int >( a[ 0 ] ), reinterpret_cast< const char * >( a[ 1 ] ),
+				OP_OPEN );
+			break;
+		case SYS_statx :
+			SLOWFS_CHECK( static_cast< int >( a[ 0 ] ), reinterpret_cast< const char * >( a[ 1 ] ),
+				OP_STAT );
+			break;
+		case SYS_getdents64 :
+			SLOWFS_CHECK( static_cast< int >( a[ 0 ] ), NULL, OP_GETDENTS );
+			break;
+		default :
+			ensure_init();
+			break;
+	}
+
+	return real_syscall( number, a[ 0 ], a[ 1 ], a[ 2 ], a[ 3 ], a[ 4 ], a[ 5 ] );
+}
+
+}  // extern "C"
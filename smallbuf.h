@@ -0,0 +1,291 @@
+/*
+    smallbuf.h -- containers that keep their contents in fixed-size storage inside the
+    object, and move to the heap only when they outgrow it.  Sized for the typical
+    run of catpath, they let a login script's invocation finish without touching the
+    heap at all.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#ifndef SMALLBUF_H
+#define SMALLBUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cstring>
+#include <new>
+#include <string>
+
+/* ---------------------------------------------------------------------------------
+   A vector with room for N elements inside the object.  Since it copies elements
+   with memcpy() and never runs their constructors or destructors, it's only for
+   plain old data types.  It can't be copied.
+   ------------------------------------------------------------------------------ */
+template< typename T, size_t N >
+class SmallVec
+{
+public:
+	SmallVec() : data_( inline_ ), size_( 0 ), capacity_( N ) {}
+
+	~SmallVec()
+	{
+		if( data_ != inline_ )
+			::operator delete( data_ );
+	}
+
+	void push_back( const T & item )
+	{
+		if( size_ == capacity_ )
+			reserve( capacity_ * 2 );
+		data_[ size_++ ] = item;
+	}
+
+	void append( const T * items, size_t count )
+	{
+		if( size_ + count > capacity_ )
+			reserve( size_ + count > capacity_ * 2 ? size_ + count : capacity_ * 2 );
+		memcpy( data_ + size_, items, count * sizeof( T ) );
+		size_ += count;
+	}
+
+	// Grow to hold at least capacity elements.  The new elements are
+	// uninitialized; resize() or push_back() gives them values.
+	void reserve( size_t capacity )
+	{
+		if( capacity <= capacity_ )
+			return;
+
+		T * data = static_cast< T * >( ::operator new( capacity * sizeof( T ) ) );
+		memcpy( data, data_, size_ * sizeof( T ) );
+		if( data_ != inline_ )
+			::operator delete( data_ );
+		data_ = data;
+		capacity_ = capacity;
+	}
+
+	// Change the size, filling any new elements with a copy of fill.
+	void resize( size_t size, const T & fill )
+	{
+		reserve( size );
+		for( size_t i = size_; i < size; ++i )
+			data_[ i ] = fill;
+		size_ = size;
+	}
+
+	void clear() { size_ = 0; }
+	size_t size() const { return size_; }
+	bool empty() const { return 0 == size_; }
+	bool on_heap() const { return data_ != inline_; }
+
+	T * data() { return data_; }
+	const T * data() const { return data_; }
+	T & operator[]( size_t i ) { return data_[ i ]; }
+	const T & operator[]( size_t i ) const { return data_[ i ]; }
+	T * begin() { return data_; }
+	T * end() { return data_ + size_; }
+	const T * begin() const { return data_; }
+	const T * end() const { return data_ + size_; }
+
+	void swap( SmallVec & other )
+	{
+		// Inline storage can't change hands, so swap the contents the slow way
+		// unless both are on the heap.
+
+		if( on_heap() && other.on_heap() )
+		{
+			T * data = data_;
+			data_ = other.data_;
+			other.data_ = data;
+			size_t n = size_;
+			size_ = other.size_;
+			other.size_ = n;
+			n = capacity_;
+			capacity_ = other.capacity_;
+			other.capacity_ = n;
+			return;
+		}
+
+		SmallVec tmp;
+		tmp.append( data(), size() );
+		clear();
+		append( other.data(), other.size() );
+		other.clear();
+		other.append( tmp.data(), tmp.size() );
+	}
+
+private:
+	SmallVec( const SmallVec & );              // Not implemented
+	SmallVec & operator=( const SmallVec & );  // Not implemented
+
+	T * data_;
+	size_t size_;
+	size_t capacity_;
+	T inline_[ N ];
+};
+
+/* ---------------------------------------------------------------------------------
+   An allocator for character strings that are all freed at once, when the arena is
+   destroyed.  The first N bytes come from inside the object; after that, the arena
+   allocates chunks from the heap.
+   ------------------------------------------------------------------------------ */
+template< size_t N >
+class Arena
+{
+public:
+	Arena() : used_( 0 ), chunks_( NULL ), chunk_used_( 0 ), chunk_size_( 0 ) {}
+
+	~Arena()
+	{
+		while( chunks_ )
+		{
+			Chunk * next = chunks_->next;
+			::operator delete( chunks_ );
+			chunks_ = next;
+		}
+	}
+
+	char * alloc( size_t len )
+	{
+		if( NULL == chunks_ && used_ + len <= N )
+		{
+			char * p = inline_ + used_;
+			used_ += len;
+			return p;
+		}
+
+		if( NULL == chunks_ || chunk_used_ + len > chunk_size_ )
+		{
+			size_t size = len > N ? len : N;
+			Chunk * chunk = static_cast< Chunk * >( ::operator new( sizeof( Chunk ) + size ) );
+			chunk->next = chunks_;
+			chunks_ = chunk;
+			chunk_used_ = 0;
+			chunk_size_ = size;
+		}
+
+		char * p = reinterpret_cast< char * >( chunks_ + 1 ) + chunk_used_;
+		chunk_used_ += len;
+		return p;
+	}
+
+private:
+	Arena( const Arena & );                    // Not implemented
+	Arena & operator=( const Arena & );        // Not implemented
+
+	struct Chunk
+	{
+		Chunk * next;
+		uint64_t align;                // Keeps what follows suitably aligned
+	};
+
+	char inline_[ N ];
+	size_t used_;
+	Chunk * chunks_;
+	size_t chunk_used_;
+	size_t chunk_size_;
+};
+
+/* ---------------------------------------------------------------------------------
+   A reference to a string that lives somewhere else, e.g. in argv or an Arena.
+   It isn't necessarily followed by a nul.
+   ------------------------------------------------------------------------------ */
+struct PathEntry
+{
+	const char * str;
+	size_t len;
+
+	std::string to_string() const { return std::string( str, len ); }
+};
+
+inline bool operator==( const PathEntry & a, const PathEntry & b )
+{
+	return a.len == b.len && 0 == memcmp( a.str, b.str, a.len );
+}
+
+/* ---------------------------------------------------------------------------------
+   A set of PathEntries, for detecting duplicates: an open-addressing hash table of
+   indexes into a SmallVec of entries owned by the caller.  Room for N slots comes
+   from inside the object; it's kept at most half full.  N must be a power of 2.
+   ------------------------------------------------------------------------------ */
+template< size_t N >
+class EntrySet
+{
+public:
+	EntrySet() : count_( 0 )
+	{
+		slots_.resize( N, 0 );
+	}
+
+	// Look for an entry.  If it isn't there, add it, along with its index in
+	// the caller's vector, and return true; otherwise return false.
+	template< typename Vec >
+	bool insert( const Vec & entries, const PathEntry & entry, size_t index )
+	{
+		if( 2 * ( count_ + 1 ) > slots_.size() )
+			rehash( entries, slots_.size() * 2 );
+
+		size_t mask = slots_.size() - 1;
+		for( size_t i = hash( entry ) & mask; ; i = ( i + 1 ) & mask )
+		{
+			uint32_t slot = slots_[ i ];
+			if( 0 == slot )
+			{
+				slots_[ i ] = static_cast< uint32_t >( index + 1 );
+				++count_;
+				return true;
+			}
+			if( entries[ slot - 1 ] == entry )
+				return false;
+		}
+	}
+
+	static size_t hash( const PathEntry & entry )
+	{
+		uint64_t h = UINT64_C( 0xcbf29ce484222325 );
+		for( size_t i = 0; i < entry.len; ++i )
+		{
+			h ^= static_cast< unsigned char >( entry.str[ i ] );
+			h *= UINT64_C( 0x100000001b3 );
+		}
+		return static_cast< size_t >( h ^ ( h >> 32 ) );
+	}
+
+private:
+	template< typename Vec >
+	void rehash( const Vec & entries, size_t new_size )
+	{
+		SmallVec< uint32_t, N > old;
+		old.swap( slots_ );
+		slots_.clear();
+		slots_.resize( new_size, 0 );
+
+		size_t mask = new_size - 1;
+		for( size_t j = 0; j < old.size(); ++j )
+		{
+			if( 0 == old[ j ] )
+				continue;
+			size_t i = hash( entries[ old[ j ] - 1 ] ) & mask;
+			while( slots_[ i ] )
+				i = ( i + 1 ) & mask;
+			slots_[ i ] = old[ j ];
+		}
+	}
+
+	SmallVec< uint32_t, N > slots_;            // Index + 1, or 0 for empty
+	size_t count_;
+};
+
+#endif
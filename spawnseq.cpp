@@ -0,0 +1,56 @@
+/*
+    spawnseq.cpp -- run each argument as a command, one after another, from the same
+    process with posix_spawnp(), and wait for each to finish.
+
+    make and xargs fork before they exec, so a fresh child does every PATH lookup.
+    This program does them all in one long-lived process instead, so that "make
+    check" can test libexecindex.so against a directory that changes between one
+    lookup and the next.  The exit status is 1 if any command couldn't be started
+    or didn't exit with status 0.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char ** environ;
+
+int main( int argc, char ** argv )
+{
+	int rc = 0;
+
+	for( int i = 1; i < argc; ++i )
+	{
+		char * cmd_argv[] = { argv[ i ], NULL };
+		pid_t pid;
+		int err = posix_spawnp( &pid, argv[ i ], NULL, NULL, cmd_argv, environ );
+		if( err )
+		{
+			fprintf( stderr, "%s: Unable to run %s: %s\n", argv[ 0 ], argv[ i ], strerror( err ) );
+			rc = 1;
+			continue;
+		}
+
+		int status;
+		if( waitpid( pid, &status, 0 ) != pid || ! WIFEXITED( status ) || WEXITSTATUS( status ) )
+			rc = 1;
+	}
+
+	return rc;
+}
@@ -0,0 +1,213 @@
+/*
+    verdictlog.cpp -- read and write a log of directory checks, kept on a shared
+    filesystem so that many machines can reuse each other's results.
+
+    Writers append each record with a single write() to a descriptor opened with
+    O_APPEND, and take no locks.  Readers map the file and scan it.  See
+    verdictlog.h for the layout.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#include "verdictlog.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace std {}
+using namespace std;
+
+static uint32_t log_checksum( const unsigned char * p, size_t len );
+static void encode_record( const LogRecord & rec, string & buf );
+
+/* ---------------------------------------------------------------------------------
+   Add a record to the log open on fd, with one write().  Return false if the
+   write failed or was cut short; the caller carries on without the log.
+   ------------------------------------------------------------------------------ */
+bool append_verdict( int fd, const LogRecord & rec )
+{
+	string buf;
+	encode_record( rec, buf );
+	if( buf.empty() )
+		return false;
+
+	ssize_t n;
+	do
+		n = write( fd, buf.data(), buf.size() );
+	while( n < 0 && EINTR == errno );
+	return n == static_cast< ssize_t >( buf.size() );
+}
+
+/* ---------------------------------------------------------------------------------
+   Load the intact records of a log, in order.  A log that doesn't exist yet is
+   empty.  Return the number of bytes skipped because they weren't part of an
+   intact record.
+   ------------------------------------------------------------------------------ */
+size_t read_verdict_log( const char * filename, vector< LogRecord > & records )
+{
+	records.clear();
+
+	int fd = open( filename, O_RDONLY | O_CLOEXEC );
+	if( fd < 0 )
+	{
+		if( ENOENT == errno )
+			return 0;
+		string msg( "Unable to open verdict log \"" );
+		msg += filename;
+		msg += "\": ";
+		msg += strerror( errno );
+		throw runtime_error( msg );
+	}
+
+	struct stat st;
+	if( fstat( fd, &st ) != 0 )
+	{
+		close( fd );
+		throw runtime_error( string( "Unable to stat verdict log \"" ) + filename + "\"" );
+	}
+
+	size_t size = st.st_size;
+	if( 0 == size )
+	{
+		close( fd );
+		return 0;
+	}
+
+	void * addr = mmap( NULL, size, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( MAP_FAILED == addr )
+		throw runtime_error( string( "Unable to map verdict log \"" ) + filename + "\"" );
+
+	const unsigned char * base = static_cast< const unsigned char * >( addr );
+	size_t skipped = 0;
+	size_t pos = 0;
+	while( pos + LOG_HEADER_SIZE <= size )
+	{
+		const unsigned char * p = base + pos;
+		uint32_t magic, length, checksum;
+		memcpy( &magic, p, 4 );
+		memcpy( &length, p + 4, 4 );
+		memcpy( &checksum, p + 8, 4 );
+
+		if( magic != LOG_MAGIC || length < LOG_HEADER_SIZE || length > LOG_MAX_RECORD ||
+			length > size - pos || checksum != log_checksum( p + 12, length - 12 ) )
+		{
+			++pos;
+			++skipped;
+			continue;
+		}
+
+		LogRecord rec;
+		memcpy( &rec.checked, p + 12, 8 );
+		memcpy( &rec.mtime_sec, p + 20, 8 );
+		memcpy( &rec.mtime_nsec, p + 28, 4 );
+		rec.keep = 0 != p[ 32 ];
+		rec.key.assign( reinterpret_cast< const char * >( p + LOG_HEADER_SIZE ),
+			length - LOG_HEADER_SIZE );
+		records.push_back( rec );
+		pos += length;
+	}
+
+	munmap( addr, size );
+	return skipped + ( size - pos );
+}
+
+/* ---------------------------------------------------------------------------------
+   Replace a log with the given records.  Write a new file and rename it over the
+   old one, so that readers see one or the other.  The new file gets a unique name
+   in the same directory, so that machines compacting the same log at once don't
+   write into each other's files; the last rename wins.
+   ------------------------------------------------------------------------------ */
+void write_verdict_log( const char * filename, const vector< LogRecord > & records )
+{
+	string buf;
+	string contents;
+	for( size_t i = 0; i < records.size(); ++i )
+	{
+		encode_record( records[ i ], buf );
+		contents += buf;
+	}
+
+	string tmp_name( filename );
+	tmp_name += ".XXXXXX";
+	int fd = mkstemp( &tmp_name[ 0 ] );
+	if( fd < 0 )
+		throw runtime_error( string( "Unable to create a temporary file for \"" ) +
+			filename + "\"" );
+
+	// Keep the permissions of the old log, which other users may append to
+
+	struct stat st;
+	fchmod( fd, 0 == stat( filename, &st ) ? st.st_mode & 07777 : 0644 );
+
+	bool ok = true;
+	size_t done = 0;
+	while( ok && done < contents.size() )
+	{
+		ssize_t n = write( fd, contents.data() + done, contents.size() - done );
+		if( n > 0 )
+			done += n;
+		else if( n < 0 && EINTR != errno )
+			ok = false;
+	}
+	ok = 0 == close( fd ) && ok;
+	if( ! ok || rename( tmp_name.c_str(), filename ) != 0 )
+	{
+		unlink( tmp_name.c_str() );
+		throw runtime_error( string( "Unable to rewrite verdict log \"" ) + filename + "\"" );
+	}
+}
+
+// Lay out a record; leave buf empty if the key is too long for one.
+static void encode_record( const LogRecord & rec, string & buf )
+{
+	buf.clear();
+	size_t length = LOG_HEADER_SIZE + rec.key.size();
+	if( length > LOG_MAX_RECORD )
+		return;
+
+	buf.resize( length );
+	unsigned char * p = reinterpret_cast< unsigned char * >( &buf[ 0 ] );
+	uint32_t magic = LOG_MAGIC;
+	uint32_t len32 = static_cast< uint32_t >( length );
+	memcpy( p, &magic, 4 );
+	memcpy( p + 4, &len32, 4 );
+	memcpy( p + 12, &rec.checked, 8 );
+	memcpy( p + 20, &rec.mtime_sec, 8 );
+	memcpy( p + 28, &rec.mtime_nsec, 4 );
+	p[ 32 ] = rec.keep ? 1 : 0;
+	memcpy( p + LOG_HEADER_SIZE, rec.key.data(), rec.key.size() );
+
+	uint32_t checksum = log_checksum( p + 12, length - 12 );
+	memcpy( p + 8, &checksum, 4 );
+}
+
+static uint32_t log_checksum( const unsigned char * p, size_t len )
+{
+	uint32_t h = 2166136261u;
+	for( size_t i = 0; i < len; ++i )
+	{
+		h ^= p[ i ];
+		h *= 16777619u;
+	}
+	return h;
+}
@@ -0,0 +1,69 @@
+/*
+    verdictlog.h -- declarations for a log of directory checks, kept on a shared
+    filesystem so that many machines can reuse each other's results.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2011 Scott McKellar mck9@swbell.net
+*/
+
+#ifndef VERDICTLOG_H
+#define VERDICTLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+   A log is nothing but records, appended one after another.  Each record is:
+
+       uint32_t magic              LOG_MAGIC
+       uint32_t length             of the whole record, in bytes
+       uint32_t checksum           FNV-1a of everything after this field
+       int64_t checked             when the check was made, in seconds since
+                                   the epoch
+       int64_t mtime_sec           modification time of the directory then, or
+       uint32_t mtime_nsec         zero if there was no directory
+       uint8_t keep                1 if the check passed, 0 if not
+       key                         the rest of the record
+
+   all in native byte order, without padding.  There is no file header, so an
+   empty file is a valid log, and every record stands on its own: a reader skips
+   anything that isn't an intact record, byte by byte, until it finds one.  That
+   keeps the log usable when appends from different machines collide, which
+   O_APPEND doesn't prevent over NFS.
+
+   The key is opaque to this module; catpath makes it from the check mode, the
+   root, and the directory.
+*/
+
+static const uint32_t LOG_MAGIC = 0x4c565043;     // "CPVL" on little-endian machines
+static const size_t LOG_HEADER_SIZE = 33;
+static const size_t LOG_MAX_RECORD = 65536;
+
+struct LogRecord
+{
+	std::string key;
+	bool keep;
+	int64_t checked;
+	int64_t mtime_sec;
+	uint32_t mtime_nsec;
+};
+
+bool append_verdict( int fd, const LogRecord & rec );
+size_t read_verdict_log( const char * filename, std::vector< LogRecord > & records );
+void write_verdict_log( const char * filename, const std::vector< LogRecord > & records );
+
+#endif